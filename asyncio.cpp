@@ -0,0 +1,444 @@
+#include "asyncio.h"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <linux/io_uring.h>
+// <linux/io_uring.h> 经由 <linux/fs.h> 定义了宏 BLOCK_SIZE（1024），会覆盖本项目的常量
+#undef BLOCK_SIZE
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ============= 引擎选择 =============
+
+AsyncIOEngine* AsyncIOEngine::create(VirtualDisk* disk) {
+    int fd = disk->nativeFd();
+    if (fd < 0) {
+        return new SyncIOEngine(disk);
+    }
+
+    UringIOEngine* uring = new UringIOEngine(fd, disk->isDirectIO(), 64);
+    if (uring->isReady()) {
+        return uring;
+    }
+    delete uring;
+
+    unsigned threads = std::thread::hardware_concurrency();
+    if (threads < 2) {
+        threads = 2;
+    }
+    if (threads > 8) {
+        threads = 8;
+    }
+    return new ThreadPoolIOEngine(disk, threads);
+}
+
+// 把一个请求拆成 readBlocks/writeBlocks 需要的逐块缓冲区指针并执行
+static bool executeRequest(VirtualDisk* disk, const BlockIORequest& request) {
+    std::vector<char*> buffers(request.count);
+    for (uint32_t i = 0; i < request.count; i++) {
+        buffers[i] = request.buffer + static_cast<size_t>(i) * BLOCK_SIZE;
+    }
+    if (request.write) {
+        return disk->writeBlocks(request.block_num, request.count, buffers.data());
+    }
+    return disk->readBlocks(request.block_num, request.count, buffers.data());
+}
+
+// ============= SyncIOEngine 实现 =============
+
+bool SyncIOEngine::submit(const BlockIORequest* requests, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        BlockIOCompletion completion;
+        completion.tag = requests[i].tag;
+        completion.ok = executeRequest(disk, requests[i]);
+        done.push_back(completion);
+    }
+    return true;
+}
+
+size_t SyncIOEngine::complete(BlockIOCompletion* completions, size_t max, bool /* wait */) {
+    size_t n = 0;
+    while (n < max && !done.empty()) {
+        completions[n++] = done.front();
+        done.pop_front();
+    }
+    return n;
+}
+
+// ============= ThreadPoolIOEngine 实现 =============
+
+ThreadPoolIOEngine::ThreadPoolIOEngine(VirtualDisk* disk, unsigned threads)
+    : disk(disk), in_flight(0), stopping(false) {
+    for (unsigned i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&ThreadPoolIOEngine::workerLoop, this));
+    }
+}
+
+ThreadPoolIOEngine::~ThreadPoolIOEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPoolIOEngine::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_cv.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (pending.empty()) {
+            return;  // stopping 且队列已空
+        }
+
+        BlockIORequest request = pending.front();
+        pending.pop_front();
+        lock.unlock();
+
+        // pread/pwrite 为定位读写，多个工作线程可以同时执行
+        BlockIOCompletion completion;
+        completion.tag = request.tag;
+        completion.ok = executeRequest(disk, request);
+
+        lock.lock();
+        done.push_back(completion);
+        in_flight--;
+        done_cv.notify_all();
+    }
+}
+
+bool ThreadPoolIOEngine::submit(const BlockIORequest* requests, size_t count) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < count; i++) {
+            pending.push_back(requests[i]);
+        }
+        in_flight += count;
+    }
+    work_cv.notify_all();
+    return true;
+}
+
+size_t ThreadPoolIOEngine::complete(BlockIOCompletion* completions, size_t max, bool wait) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (wait) {
+        done_cv.wait(lock, [this] { return !done.empty() || in_flight == 0; });
+    }
+
+    size_t n = 0;
+    while (n < max && !done.empty()) {
+        completions[n++] = done.front();
+        done.pop_front();
+    }
+    return n;
+}
+
+size_t ThreadPoolIOEngine::inFlight() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return in_flight + done.size();
+}
+
+// ============= UringIOEngine 实现 =============
+
+static int sysIoUringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sysIoUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                                    nullptr, 0));
+}
+
+UringIOEngine::UringIOEngine(int fd, bool direct_io, unsigned entries)
+    : disk_fd(fd), direct_io(direct_io), ring_fd(-1), entries(0),
+      sq_ring(MAP_FAILED), cq_ring(MAP_FAILED), sq_ring_size(0), cq_ring_size(0),
+      sqes(nullptr), in_flight(0) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int rfd = sysIoUringSetup(entries, &params);
+    if (rfd < 0) {
+        return;  // 内核不支持或被禁用（如 seccomp），由调用者退回线程池
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   rfd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        ::close(rfd);
+        return;
+    }
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       rfd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            munmap(sq_ring, sq_ring_size);
+            sq_ring = MAP_FAILED;
+            ::close(rfd);
+            return;
+        }
+    }
+
+    void* sqe_mem = mmap(nullptr, params.sq_entries * sizeof(struct io_uring_sqe),
+                         PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQES);
+    if (sqe_mem == MAP_FAILED) {
+        if (cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        munmap(sq_ring, sq_ring_size);
+        sq_ring = cq_ring = MAP_FAILED;
+        ::close(rfd);
+        return;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqe_mem);
+
+    char* sq = static_cast<char*>(sq_ring);
+    char* cq = static_cast<char*>(cq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    ring_fd = rfd;
+    this->entries = params.sq_entries;
+    if (!probeOpcodes()) {
+        // 5.1 ~ 5.5 的内核可以建立 ring，但不支持 IORING_OP_READ/WRITE，每次 I/O 都会返回 -EINVAL
+        munmap(sqes, this->entries * sizeof(struct io_uring_sqe));
+        if (cq_ring != sq_ring) {
+            munmap(cq_ring, cq_ring_size);
+        }
+        munmap(sq_ring, sq_ring_size);
+        sq_ring = cq_ring = MAP_FAILED;
+        ::close(rfd);
+        ring_fd = -1;
+        return;
+    }
+    slots.resize(this->entries);
+    for (unsigned i = 0; i < this->entries; i++) {
+        slots[i].busy = false;
+        slots[i].bounce = nullptr;
+        slots[i].buffer = nullptr;
+        slots[i].done = 0;
+        free_slots.push_back(this->entries - 1 - i);
+    }
+}
+
+bool UringIOEngine::probeOpcodes() {
+    // IORING_REGISTER_PROBE 与这两个操作码同在 5.6 引入，更早的内核注册失败即视为不支持
+    size_t size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    std::vector<char> buffer(size, 0);
+    struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(buffer.data());
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) {
+        return false;
+    }
+    const unsigned needed[] = {IORING_OP_READ, IORING_OP_WRITE};
+    for (unsigned op : needed) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void UringIOEngine::queue(unsigned index, unsigned& tail) {
+    const Slot& slot = slots[index];
+    size_t length = static_cast<size_t>(slot.request.count) * BLOCK_SIZE;
+    struct io_uring_sqe* sqe = &sqes[tail & *sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = slot.request.write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = disk_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(slot.buffer + slot.done);
+    sqe->len = static_cast<uint32_t>(length - slot.done);
+    sqe->off = static_cast<uint64_t>(slot.request.block_num) * BLOCK_SIZE + slot.done;
+    sqe->user_data = index;
+    sq_array[tail & *sq_mask] = tail & *sq_mask;
+    tail++;
+}
+
+UringIOEngine::~UringIOEngine() {
+    if (ring_fd < 0) {
+        return;
+    }
+
+    // 等待在途请求完成，避免内核继续写入已释放的缓冲区
+    while (in_flight > 0) {
+        if (reap() == 0 && !enter(0, 1)) {
+            break;
+        }
+    }
+
+    munmap(sqes, entries * sizeof(struct io_uring_sqe));
+    if (cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    munmap(sq_ring, sq_ring_size);
+    ::close(ring_fd);
+}
+
+bool UringIOEngine::enter(unsigned to_submit, unsigned min_complete) {
+    unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (true) {
+        int ret = sysIoUringEnter(ring_fd, to_submit, min_complete, flags);
+        if (ret >= 0) {
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+size_t UringIOEngine::reap() {
+    size_t reaped = 0;
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    std::vector<unsigned> resubmit;
+
+    while (head != tail) {
+        const struct io_uring_cqe& cqe = cqes[head & *cq_mask];
+        unsigned index = static_cast<unsigned>(cqe.user_data);
+        Slot& slot = slots[index];
+        size_t expected = static_cast<size_t>(slot.request.count) * BLOCK_SIZE;
+        head++;
+
+        // 部分完成：从已完成处继续，槽位仍在途（返回 0 说明到了文件末尾，按失败处理）
+        if (cqe.res > 0 && slot.done + cqe.res < expected) {
+            slot.done += cqe.res;
+            resubmit.push_back(index);
+            continue;
+        }
+
+        BlockIOCompletion completion;
+        completion.tag = slot.request.tag;
+        completion.ok = cqe.res >= 0 && slot.done + cqe.res == expected;
+
+        if (slot.bounce) {
+            if (completion.ok && !slot.request.write) {
+                memcpy(slot.request.buffer, slot.bounce, expected);
+            }
+            freeBlockBuffer(slot.bounce);
+            slot.bounce = nullptr;
+        }
+        slot.busy = false;
+        free_slots.push_back(index);
+
+        done.push_back(completion);
+        in_flight--;
+        reaped++;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    // 每个槽位最多占用一个 SQE，重新提交不会超出提交队列
+    if (!resubmit.empty()) {
+        unsigned sq = *sq_tail;
+        for (unsigned index : resubmit) {
+            queue(index, sq);
+        }
+        __atomic_store_n(sq_tail, sq, __ATOMIC_RELEASE);
+        if (!enter(static_cast<unsigned>(resubmit.size()), 0)) {
+            // 无法重新提交：这些请求按失败完成
+            for (unsigned index : resubmit) {
+                Slot& slot = slots[index];
+                if (slot.bounce) {
+                    freeBlockBuffer(slot.bounce);
+                    slot.bounce = nullptr;
+                }
+                slot.busy = false;
+                free_slots.push_back(index);
+                BlockIOCompletion completion;
+                completion.tag = slot.request.tag;
+                completion.ok = false;
+                done.push_back(completion);
+                in_flight--;
+                reaped++;
+            }
+        }
+    }
+    return reaped;
+}
+
+bool UringIOEngine::submit(const BlockIORequest* requests, size_t count) {
+    size_t next = 0;
+    while (next < count) {
+        // 没有空闲槽位时先提交已排队的请求并等待部分完成
+        if (free_slots.empty()) {
+            reap();
+            if (free_slots.empty() && !enter(0, 1)) {
+                return false;
+            }
+            continue;
+        }
+
+        unsigned queued = 0;
+        unsigned tail = *sq_tail;
+        while (next < count && !free_slots.empty()) {
+            const BlockIORequest& request = requests[next];
+            unsigned index = free_slots.back();
+            Slot& slot = slots[index];
+            slot.request = request;
+            slot.bounce = nullptr;
+            slot.done = 0;
+            slot.busy = true;
+
+            size_t length = static_cast<size_t>(request.count) * BLOCK_SIZE;
+            char* buffer = request.buffer;
+            if (direct_io && reinterpret_cast<uintptr_t>(buffer) % DISK_IO_ALIGNMENT != 0) {
+                slot.bounce = allocateBlockBuffer(request.count);
+                if (!slot.bounce) {
+                    slot.busy = false;
+                    break;
+                }
+                if (request.write) {
+                    memcpy(slot.bounce, buffer, length);
+                }
+                buffer = slot.bounce;
+            }
+            free_slots.pop_back();
+            slot.buffer = buffer;
+            queue(index, tail);
+            queued++;
+            next++;
+        }
+
+        if (queued == 0) {
+            return false;
+        }
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+        in_flight += queued;
+        if (!enter(queued, 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t UringIOEngine::complete(BlockIOCompletion* completions, size_t max, bool wait) {
+    reap();
+    while (wait && done.empty() && in_flight > 0) {
+        if (!enter(0, 1)) {
+            break;
+        }
+        reap();
+    }
+
+    size_t n = 0;
+    while (n < max && !done.empty()) {
+        completions[n++] = done.front();
+        done.pop_front();
+    }
+    return n;
+}
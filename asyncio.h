@@ -0,0 +1,126 @@
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include "virtualdisk.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// ============= 异步块 I/O 引擎接口 =============
+// 一次提交一批请求，完成顺序不保证与提交顺序一致，调用者通过 tag 区分。
+class AsyncIOEngine {
+public:
+    virtual ~AsyncIOEngine() {}
+
+    // 为磁盘选择合适的引擎：有文件描述符时优先 io_uring，失败则退回线程池；
+    // 其他后端在提交时同步完成
+    static AsyncIOEngine* create(VirtualDisk* disk);
+
+    virtual bool submit(const BlockIORequest* requests, size_t count) = 0;
+    // 收割已完成的请求，wait 为 true 时至少等到一个完成（若仍有在途请求）
+    virtual size_t complete(BlockIOCompletion* completions, size_t max, bool wait) = 0;
+    virtual size_t inFlight() const = 0;
+    virtual const char* name() const = 0;
+};
+
+// ============= 同步引擎 =============
+// 提交时直接调用 readBlocks/writeBlocks，适用于 fstream / mmap 后端
+class SyncIOEngine : public AsyncIOEngine {
+private:
+    VirtualDisk* disk;
+    std::deque<BlockIOCompletion> done;
+
+public:
+    SyncIOEngine(VirtualDisk* disk) : disk(disk) {}
+
+    bool submit(const BlockIORequest* requests, size_t count);
+    size_t complete(BlockIOCompletion* completions, size_t max, bool wait);
+    size_t inFlight() const { return done.size(); }
+    const char* name() const { return "sync"; }
+};
+
+// ============= 线程池引擎（io_uring 不可用时的后备）=============
+class ThreadPoolIOEngine : public AsyncIOEngine {
+private:
+    VirtualDisk* disk;
+    std::vector<std::thread> workers;
+    std::deque<BlockIORequest> pending;
+    std::deque<BlockIOCompletion> done;
+    size_t in_flight;
+    bool stopping;
+    mutable std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+
+    void workerLoop();
+
+public:
+    ThreadPoolIOEngine(VirtualDisk* disk, unsigned threads);
+    ~ThreadPoolIOEngine();
+
+    bool submit(const BlockIORequest* requests, size_t count);
+    size_t complete(BlockIOCompletion* completions, size_t max, bool wait);
+    size_t inFlight() const;
+    const char* name() const { return "threadpool"; }
+};
+
+// ============= io_uring 引擎 =============
+// 直接使用 io_uring_setup / io_uring_enter 系统调用，不依赖 liburing。
+// IORING_OP_READ / IORING_OP_WRITE 要求 5.6 以上的内核：创建时用 IORING_REGISTER_PROBE
+// 确认支持，否则不启用（由调用者退回线程池）。
+// 读写不足请求长度时从已完成处继续提交剩余部分，而不是把整个请求判为失败
+class UringIOEngine : public AsyncIOEngine {
+private:
+    struct Slot {
+        BlockIORequest request;
+        char* bounce;   // O_DIRECT 下未对齐缓冲区的中转区
+        char* buffer;   // 实际交给内核的缓冲区（bounce 或调用者缓冲区）
+        size_t done;    // 已完成的字节数
+        bool busy;
+    };
+
+    int disk_fd;
+    bool direct_io;
+    int ring_fd;
+    unsigned entries;
+
+    // SQ / CQ 环形队列（映射自内核）
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    std::vector<Slot> slots;
+    std::vector<unsigned> free_slots;
+    std::deque<BlockIOCompletion> done;
+    size_t in_flight;
+
+    bool probeOpcodes();               // 内核是否支持所用的读写操作码
+    void queue(unsigned index, unsigned& tail);  // 为槽位剩余的部分填写一个 SQE
+    bool enter(unsigned to_submit, unsigned min_complete);
+    size_t reap();
+
+public:
+    UringIOEngine(int fd, bool direct_io, unsigned entries);
+    ~UringIOEngine();
+
+    bool isReady() const { return ring_fd >= 0; }
+    bool submit(const BlockIORequest* requests, size_t count);
+    size_t complete(BlockIOCompletion* completions, size_t max, bool wait);
+    size_t inFlight() const { return in_flight + done.size(); }
+    const char* name() const { return "io_uring"; }
+};
+
+#endif // ASYNCIO_H
@@ -0,0 +1,174 @@
+#include "bitmap.h"
+#include <algorithm>
+#include <cstring>
+
+// ============= Bitmap 实现 =============
+
+Bitmap::Bitmap(uint32_t bits) : bit_count(0) {
+    resize(bits);
+}
+
+void Bitmap::resize(uint32_t bits) {
+    bit_count = bits;
+    words.assign((static_cast<size_t>(bits) + 63) / 64, 0);
+}
+
+void Bitmap::clearAll() {
+    std::fill(words.begin(), words.end(), 0);
+}
+
+void Bitmap::setRange(uint32_t start, uint32_t count) {
+    for (uint32_t bit = start; bit < start + count; bit++) {
+        set(bit);
+    }
+}
+
+uint32_t Bitmap::count(uint32_t from, uint32_t to) const {
+    if (to > bit_count) {
+        to = bit_count;
+    }
+    uint32_t total = 0;
+    while (from < to) {
+        // 按字统计，首尾不完整的字屏蔽掉范围之外的位
+        uint64_t word = words[from / 64] & (~0ULL << (from % 64));
+        uint32_t next = (from & ~63u) + 64;
+        if (next > to) {
+            word &= (1ULL << (to % 64)) - 1;
+            next = to;
+        }
+        total += static_cast<uint32_t>(__builtin_popcountll(word));
+        from = next;
+    }
+    return total;
+}
+
+uint32_t Bitmap::scan(uint32_t from, uint32_t to, bool value) const {
+    if (to > bit_count) {
+        to = bit_count;
+    }
+    while (from < to) {
+        // 查找 1 直接用原字，查找 0 用取反后的字；并屏蔽掉 from 之前的位
+        uint64_t word = words[from / 64];
+        if (!value) {
+            word = ~word;
+        }
+        word &= ~0ULL << (from % 64);
+        if (word != 0) {
+            uint32_t bit = (from & ~63u) + static_cast<uint32_t>(__builtin_ctzll(word));
+            return std::min(bit, to);
+        }
+        from = (from & ~63u) + 64;
+    }
+    return to;
+}
+
+uint32_t Bitmap::allocate(uint32_t low, uint32_t high, uint32_t& cursor) {
+    if (high > bit_count) {
+        high = bit_count;
+    }
+    if (low >= high) {
+        return UINT32_MAX;
+    }
+
+    uint32_t start = (cursor >= low && cursor < high) ? cursor : low;
+    uint32_t bit = scan(start, high, false);
+    if (bit == high) {
+        bit = scan(low, start, false);
+        if (bit == start) {
+            return UINT32_MAX;
+        }
+    }
+    set(bit);
+    cursor = bit + 1;
+    return bit;
+}
+
+uint32_t Bitmap::findRun(uint32_t count, uint32_t low, uint32_t high, uint32_t cursor) const {
+    if (high > bit_count) {
+        high = bit_count;
+    }
+    if (count == 0 || low >= high || count > high - low) {
+        return UINT32_MAX;
+    }
+
+    // 先查找起点在 [游标, high) 的区间，再回绕查找起点在 [low, 游标) 的区间；
+    // 每次从一个空闲位出发找到下一个已用位，区间长度足够即成功
+    uint32_t start = (cursor >= low && cursor < high) ? cursor : low;
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t from = pass == 0 ? start : low;
+        uint32_t to = pass == 0 ? high : start;
+        while (from < to) {
+            uint32_t run_start = scan(from, to, false);
+            if (run_start >= to) {
+                break;
+            }
+            uint32_t run_end = scan(run_start, high, true);
+            if (run_end - run_start >= count) {
+                return run_start;
+            }
+            from = run_end;
+        }
+    }
+    return UINT32_MAX;
+}
+
+uint32_t Bitmap::allocateRun(uint32_t count, uint32_t low, uint32_t high, uint32_t& cursor) {
+    uint32_t start = findRun(count, low, high, cursor);
+    if (start != UINT32_MAX) {
+        setRange(start, count);
+        cursor = start + count;
+    }
+    return start;
+}
+
+uint32_t Bitmap::allocateUpTo(uint32_t max_count, uint32_t low, uint32_t high, uint32_t& cursor,
+                              uint32_t& count) {
+    count = 0;
+    if (high > bit_count) {
+        high = bit_count;
+    }
+    if (max_count == 0 || low >= high) {
+        return UINT32_MAX;
+    }
+
+    uint32_t start = (cursor >= low && cursor < high) ? cursor : low;
+    uint32_t bit = scan(start, high, false);
+    if (bit == high) {
+        bit = scan(low, start, false);
+        if (bit == start) {
+            return UINT32_MAX;
+        }
+    }
+    uint32_t end = scan(bit, std::min(high, bit + max_count), true);
+    count = end - bit;
+    setRange(bit, count);
+    cursor = end;
+    return bit;
+}
+
+uint32_t Bitmap::allocateAt(uint32_t start, uint32_t max_count, uint32_t high) {
+    if (high > bit_count) {
+        high = bit_count;
+    }
+    if (start >= high || max_count == 0) {
+        return 0;
+    }
+    uint32_t end = scan(start, std::min(high, start + max_count), true);
+    setRange(start, end - start);
+    return end - start;
+}
+
+void Bitmap::load(const char* data, size_t bytes) {
+    std::fill(words.begin(), words.end(), 0);
+    memcpy(words.data(), data, std::min(bytes, byteSize()));
+    // 清除超出 bit_count 的尾部位，保证查找不会越界
+    if (bit_count % 64 != 0) {
+        words.back() &= (1ULL << (bit_count % 64)) - 1;
+    }
+}
+
+void Bitmap::store(char* data, size_t bytes, size_t offset) const {
+    size_t length = offset < byteSize() ? std::min(bytes, byteSize() - offset) : 0;
+    memcpy(data, reinterpret_cast<const char*>(words.data()) + offset, length);
+    memset(data + length, 0, bytes - length);
+}
@@ -0,0 +1,61 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// ============= 位图 =============
+// 以 64 位字存储，第 i 位位于第 i / 64 个字的第 i % 64 位。
+// 在小端机器上其字节序与磁盘格式（第 i 位位于第 i / 8 字节的第 i % 8 位）一致，
+// 因此加载/保存就是一次 memcpy。
+// 查找空闲位按字进行：整字全满时直接跳过，否则用 __builtin_ctzll 定位。
+// next-fit 游标由调用者保存并传入（每个分配组一个）：只要各调用者的 [low, high)
+// 按 64 位对齐、互不重叠，它们就不会访问同一个字，可以在各自的锁下并行分配。
+class Bitmap {
+private:
+    std::vector<uint64_t> words;
+    uint32_t bit_count;
+
+    // 在 [from, to) 中查找第一个值为 value 的位，找不到返回 to
+    uint32_t scan(uint32_t from, uint32_t to, bool value) const;
+
+public:
+    Bitmap(uint32_t bits = 0);
+
+    void resize(uint32_t bits);
+    void clearAll();
+    uint32_t size() const { return bit_count; }
+    size_t byteSize() const { return (bit_count + 7) / 8; }
+
+    bool test(uint32_t bit) const {
+        return (words[bit / 64] >> (bit % 64)) & 1;
+    }
+    void set(uint32_t bit) { words[bit / 64] |= 1ULL << (bit % 64); }
+    void clear(uint32_t bit) { words[bit / 64] &= ~(1ULL << (bit % 64)); }
+    void setRange(uint32_t start, uint32_t count);
+    uint32_t count(uint32_t from, uint32_t to) const;  // [from, to) 中置 1 的位数
+
+    // 从游标开始（到 high 后回绕到 low）在 [low, high) 中分配一位并置 1，
+    // 失败返回 UINT32_MAX；成功时游标移到分配位之后
+    uint32_t allocate(uint32_t low, uint32_t high, uint32_t& cursor);
+    // 在 [low, high) 中查找长度至少为 count 的连续空闲区间，同样从游标开始回绕，
+    // 返回起始位，失败返回 UINT32_MAX（不修改位图）
+    uint32_t findRun(uint32_t count, uint32_t low, uint32_t high, uint32_t cursor) const;
+    // 查找并占用长度为 count 的连续空闲区间
+    uint32_t allocateRun(uint32_t count, uint32_t low, uint32_t high, uint32_t& cursor);
+    // 从游标处的第一个空闲位开始占用至多 max_count 个连续空闲位，
+    // 实际长度写入 count，失败返回 UINT32_MAX
+    uint32_t allocateUpTo(uint32_t max_count, uint32_t low, uint32_t high, uint32_t& cursor,
+                          uint32_t& count);
+    // 从指定位 start 开始占用至多 max_count 个连续空闲位（start 已被占用时为 0），
+    // 返回实际占用的位数；用于紧接在已有区间之后扩展
+    uint32_t allocateAt(uint32_t start, uint32_t max_count, uint32_t high);
+
+    // 与磁盘字节格式互相转换，bytes 不足或超出的部分按 0 处理；
+    // store 可以只取从第 offset 字节开始的一段（按块写回多块位图）
+    void load(const char* data, size_t bytes);
+    void store(char* data, size_t bytes, size_t offset = 0) const;
+};
+
+#endif // BITMAP_H
@@ -0,0 +1,425 @@
+#include "blockcache.h"
+#include <algorithm>
+#include <cstring>
+
+// ============= BlockCache 实现 =============
+
+BlockCache::BlockCache(VirtualDisk* disk, uint32_t capacity)
+    : disk(disk), mapped(disk->isMapped()), capacity(capacity), unsynced(false) {
+    if (this->capacity == 0) {
+        this->capacity = 1;
+    }
+}
+
+BlockCache::~BlockCache() {
+    flush();
+}
+
+BlockCache::CacheFrame* BlockCache::lookup(uint32_t block_num, bool load) {
+    auto it = frames.find(block_num);
+    if (it != frames.end()) {
+        stats.hits++;
+        // 移动到 LRU 表头
+        lru.splice(lru.begin(), lru, it->second);
+        return &(*it->second);
+    }
+
+    stats.misses++;
+    evictIfNeeded();
+
+    CacheFrame frame;
+    frame.block_num = block_num;
+    frame.dirty = false;
+    frame.pin_count = 0;
+    frame.data.reset(allocateBlockBuffer(1));
+    if (!frame.data) {
+        return nullptr;
+    }
+    memset(frame.data.get(), 0, BLOCK_SIZE);
+
+    if (load) {
+        if (!disk->readBlock(block_num, frame.data.get())) {
+            return nullptr;
+        }
+        stats.disk_reads++;
+    }
+
+    lru.push_front(std::move(frame));
+    frames[block_num] = lru.begin();
+    return &lru.front();
+}
+
+void BlockCache::evictIfNeeded() {
+    if (frames.size() < capacity) {
+        return;
+    }
+
+    // 从表尾开始找第一个未被 pin 的块；全部被 pin 时允许暂时超出容量
+    for (auto it = lru.end(); it != lru.begin();) {
+        --it;
+        if (it->pin_count > 0) {
+            continue;
+        }
+        if (it->dirty && !writeBack(*it)) {
+            continue;
+        }
+        frames.erase(it->block_num);
+        lru.erase(it);
+        stats.evictions++;
+        return;
+    }
+}
+
+bool BlockCache::writeBack(CacheFrame& frame) {
+    if (!disk->writeBlock(frame.block_num, frame.data.get())) {
+        return false;
+    }
+    frame.dirty = false;
+    stats.disk_writes++;
+    unsynced = true;
+    return true;
+}
+
+char* BlockCache::mappedBlock(uint32_t block_num) {
+    char* block = disk->mapBlock(block_num);
+    if (block) {
+        stats.hits++;
+    }
+    return block;
+}
+
+bool BlockCache::readBlock(uint32_t block_num, char* buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mapped) {
+        char* block = mappedBlock(block_num);
+        if (!block) {
+            return false;
+        }
+        memcpy(buffer, block, BLOCK_SIZE);
+        return true;
+    }
+
+    CacheFrame* frame = lookup(block_num, true);
+    if (!frame) {
+        return false;
+    }
+    memcpy(buffer, frame->data.get(), BLOCK_SIZE);
+    return true;
+}
+
+bool BlockCache::writeBlock(uint32_t block_num, const char* buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mapped) {
+        char* block = mappedBlock(block_num);
+        if (!block) {
+            return false;
+        }
+        memcpy(block, buffer, BLOCK_SIZE);
+        disk->markBlockDirty(block_num);
+        unsynced = true;
+        return true;
+    }
+
+    CacheFrame* frame = lookup(block_num, false);
+    if (!frame) {
+        return false;
+    }
+    memcpy(frame->data.get(), buffer, BLOCK_SIZE);
+    frame->dirty = true;
+    return true;
+}
+
+// 把 (块号, 缓冲区) 追加到请求列表；块号与缓冲区都连续时并入上一个请求
+static void appendRequest(std::vector<BlockIORequest>& requests, uint32_t block_num,
+                          char* buffer, bool write) {
+    if (!requests.empty()) {
+        BlockIORequest& last = requests.back();
+        if (block_num == last.block_num + last.count &&
+            buffer == last.buffer + static_cast<size_t>(last.count) * BLOCK_SIZE) {
+            last.count++;
+            return;
+        }
+    }
+    BlockIORequest request;
+    request.block_num = block_num;
+    request.count = 1;
+    request.buffer = buffer;
+    request.write = write;
+    request.tag = requests.size();
+    requests.push_back(request);
+}
+
+bool BlockCache::readBlocks(const uint32_t* blocks, char* const* buffers, size_t count) {
+    std::vector<BlockIORequest> requests;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (size_t i = 0; i < count; i++) {
+        if (mapped) {
+            char* block = mappedBlock(blocks[i]);
+            if (!block) {
+                return false;
+            }
+            memcpy(buffers[i], block, BLOCK_SIZE);
+            continue;
+        }
+
+        auto it = frames.find(blocks[i]);
+        if (it != frames.end()) {
+            stats.hits++;
+            memcpy(buffers[i], it->second->data.get(), BLOCK_SIZE);
+            continue;
+        }
+        stats.misses++;
+        stats.disk_reads++;
+        appendRequest(requests, blocks[i], buffers[i], false);
+    }
+    lock.unlock();
+    return disk->runIO(requests);
+}
+
+bool BlockCache::writeBlocks(const uint32_t* blocks, const char* const* buffers, size_t count) {
+    if (mapped) {
+        for (size_t i = 0; i < count; i++) {
+            if (!writeBlock(blocks[i], buffers[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<BlockIORequest> requests;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (size_t i = 0; i < count; i++) {
+        // 已缓存的块必须更新缓存帧，否则之后写回会覆盖新数据
+        auto it = frames.find(blocks[i]);
+        if (it != frames.end()) {
+            memcpy(it->second->data.get(), buffers[i], BLOCK_SIZE);
+            it->second->dirty = true;
+            continue;
+        }
+        stats.disk_writes++;
+        appendRequest(requests, blocks[i], const_cast<char*>(buffers[i]), true);
+    }
+    if (requests.empty()) {
+        return true;
+    }
+    lock.unlock();
+    if (!disk->runIO(requests)) {
+        return false;
+    }
+
+    // 写入完成后才标记待刷盘，避免并发的 flush 在数据落盘前清除标记
+    lock.lock();
+    unsynced = true;
+    return true;
+}
+
+bool BlockCache::prefetchBlocks(const uint32_t* blocks, size_t count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mapped) {
+        return true;
+    }
+
+    // 最多预读半个缓存，避免把刚读入的块又挤出去
+    std::vector<uint32_t> loading;
+    std::vector<BlockIORequest> requests;
+    for (size_t i = 0; i < count && loading.size() < capacity / 2; i++) {
+        if (frames.find(blocks[i]) != frames.end()) {
+            continue;
+        }
+        CacheFrame* frame = lookup(blocks[i], false);
+        if (!frame) {
+            break;
+        }
+        stats.disk_reads++;
+        frame->pin_count++;
+        loading.push_back(blocks[i]);
+        appendRequest(requests, blocks[i], frame->data.get(), false);
+    }
+
+    // 新帧在读入完成前不能被其他线程看到，因此持锁等待
+    bool ok = disk->runIO(requests);
+    for (uint32_t block_num : loading) {
+        frames[block_num]->pin_count--;
+        if (!ok) {
+            discardFrame(block_num);  // 读取失败的帧内容无效
+        }
+    }
+    return ok;
+}
+
+char* BlockCache::pinBlock(uint32_t block_num, bool load) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mapped) {
+        return mappedBlock(block_num);
+    }
+
+    CacheFrame* frame = lookup(block_num, load);
+    if (!frame) {
+        return nullptr;
+    }
+    frame->pin_count++;
+    return frame->data.get();
+}
+
+void BlockCache::unpinBlock(uint32_t block_num, bool dirty) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mapped) {
+        if (dirty) {
+            disk->markBlockDirty(block_num);
+            unsynced = true;
+        }
+        return;
+    }
+
+    auto it = frames.find(block_num);
+    if (it == frames.end()) {
+        return;
+    }
+    CacheFrame& frame = *it->second;
+    if (frame.pin_count > 0) {
+        frame.pin_count--;
+    }
+    if (dirty) {
+        frame.dirty = true;
+    }
+}
+
+bool BlockCache::snapshotBlock(uint32_t block_num, char* buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mapped) {
+        char* block = mappedBlock(block_num);
+        if (!block) {
+            return false;
+        }
+        memcpy(buffer, block, BLOCK_SIZE);
+        return true;
+    }
+
+    auto it = frames.find(block_num);
+    if (it == frames.end()) {
+        return false;
+    }
+    memcpy(buffer, it->second->data.get(), BLOCK_SIZE);
+    it->second->dirty = false;
+    return true;
+}
+
+bool BlockCache::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // 按块号顺序写回，尽量让物理写入保持顺序。
+    // 被 pin 的帧可能正被其他线程修改，留给它们之后的提交写回
+    std::vector<CacheFrame*> dirty_frames;
+    for (auto& frame : lru) {
+        if (frame.dirty && frame.pin_count == 0) {
+            dirty_frames.push_back(&frame);
+        }
+    }
+    std::sort(dirty_frames.begin(), dirty_frames.end(),
+        [](const CacheFrame* a, const CacheFrame* b) {
+            return a->block_num < b->block_num;
+        });
+
+    // 块号连续的脏块合并为一次向量写（pwritev）
+    bool ok = true;
+    std::vector<const char*> buffers;
+    size_t i = 0;
+    while (i < dirty_frames.size()) {
+        size_t j = i + 1;
+        while (j < dirty_frames.size() &&
+               dirty_frames[j]->block_num == dirty_frames[j - 1]->block_num + 1) {
+            j++;
+        }
+
+        buffers.clear();
+        for (size_t k = i; k < j; k++) {
+            buffers.push_back(dirty_frames[k]->data.get());
+        }
+        uint32_t count = static_cast<uint32_t>(j - i);
+        if (disk->writeBlocks(dirty_frames[i]->block_num, count, buffers.data())) {
+            for (size_t k = i; k < j; k++) {
+                dirty_frames[k]->dirty = false;
+            }
+            stats.disk_writes += count;
+            unsynced = true;
+        } else {
+            ok = false;
+        }
+        i = j;
+    }
+
+    // 刷盘在锁外进行，期间其他线程仍可访问缓存
+    if (unsynced) {
+        unsynced = false;
+        stats.flushes++;
+        lock.unlock();
+        if (!disk->flush()) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool BlockCache::refreshBlock(uint32_t block_num) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = frames.find(block_num);
+    if (it == frames.end()) {
+        return true;
+    }
+    CacheFrame& frame = *it->second;
+    if (frame.dirty || frame.pin_count > 0) {
+        // 本进程的修改尚未写回，以内存副本为准
+        return true;
+    }
+    if (!disk->readBlock(block_num, frame.data.get())) {
+        return false;
+    }
+    stats.disk_reads++;
+    return true;
+}
+
+void BlockCache::discardBlock(uint32_t block_num) {
+    std::lock_guard<std::mutex> lock(mutex);
+    discardFrame(block_num);
+}
+
+void BlockCache::discardFrame(uint32_t block_num) {
+    auto it = frames.find(block_num);
+    if (it == frames.end()) {
+        return;
+    }
+    if (it->second->pin_count > 0) {
+        it->second->dirty = false;
+        return;
+    }
+    lru.erase(it->second);
+    frames.erase(it);
+}
+
+void BlockCache::invalidate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    lru.clear();
+    frames.clear();
+    unsynced = false;
+}
+
+uint32_t BlockCache::getDirtyCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t count = 0;
+    for (const auto& frame : lru) {
+        if (frame.dirty) {
+            count++;
+        }
+    }
+    return count;
+}
+
+BlockCacheStats BlockCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void BlockCache::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats = BlockCacheStats();
+}
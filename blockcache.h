@@ -0,0 +1,94 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include "virtualdisk.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// ============= 块缓存常量 =============
+const uint32_t DEFAULT_CACHE_BLOCKS = 256;     // 默认缓存 256 块（1MB）
+
+// ============= 块缓存统计 =============
+struct BlockCacheStats {
+    uint64_t hits;          // 命中次数
+    uint64_t misses;        // 未命中次数
+    uint64_t disk_reads;    // 物理读块数
+    uint64_t disk_writes;   // 物理写块数
+    uint64_t evictions;     // 淘汰次数
+    uint64_t flushes;       // 刷盘次数
+
+    BlockCacheStats()
+        : hits(0), misses(0), disk_reads(0), disk_writes(0), evictions(0), flushes(0) {}
+};
+
+// ============= 块缓存（写回式 LRU）=============
+// 位于 FileSystem 与 VirtualDisk 之间：读命中直接返回内存副本，
+// 写入只标记脏块，直到 flush() 或被淘汰时才写回磁盘。
+// 被 pin 住的块不会被淘汰，调用者可以直接在缓存帧上读写。
+// 磁盘为映射型后端（mmap）时不再建立缓存帧，直接交出映射区中的块地址。
+// 线程安全：帧表、LRU 和统计由一把互斥锁保护；缓存帧内容的并发访问由调用者
+// （文件/目录锁）负责。批量数据读写的磁盘 I/O 在锁外进行。
+class BlockCache {
+private:
+    struct BufferDeleter {
+        void operator()(char* buffer) const { freeBlockBuffer(buffer); }
+    };
+
+    struct CacheFrame {
+        uint32_t block_num;
+        bool dirty;
+        int pin_count;
+        std::unique_ptr<char, BufferDeleter> data;  // 按 O_DIRECT 要求对齐
+    };
+
+    VirtualDisk* disk;
+    bool mapped;                // 磁盘是否为映射型后端
+    uint32_t capacity;
+    std::list<CacheFrame> lru;  // 表头为最近使用的块
+    std::unordered_map<uint32_t, std::list<CacheFrame>::iterator> frames;
+    BlockCacheStats stats;
+    bool unsynced;              // 是否有已写回但尚未 flush 的数据
+    mutable std::mutex mutex;
+
+    CacheFrame* lookup(uint32_t block_num, bool load);
+    void evictIfNeeded();
+    bool writeBack(CacheFrame& frame);
+    char* mappedBlock(uint32_t block_num);
+    void discardFrame(uint32_t block_num);
+
+public:
+    BlockCache(VirtualDisk* disk, uint32_t capacity = DEFAULT_CACHE_BLOCKS);
+    ~BlockCache();
+
+    bool readBlock(uint32_t block_num, char* buffer);
+    bool writeBlock(uint32_t block_num, const char* buffer);
+
+    // 批量读写（文件数据路径）：命中的块走缓存，其余合并成连续请求
+    // 一次性提交给磁盘的异步引擎；未命中的数据块不进入缓存
+    bool readBlocks(const uint32_t* blocks, char* const* buffers, size_t count);
+    bool writeBlocks(const uint32_t* blocks, const char* const* buffers, size_t count);
+    // 预读：把未缓存的块一次性异步读入缓存（目录扫描等元数据路径）
+    bool prefetchBlocks(const uint32_t* blocks, size_t count);
+
+    // 固定块并返回缓存帧指针；load 为 false 时不从磁盘读取（整块覆盖写）
+    char* pinBlock(uint32_t block_num, bool load = true);
+    void unpinBlock(uint32_t block_num, bool dirty);
+    // 复制被 pin 的块并标记为干净（日志提交：由日志负责写回原位）
+    bool snapshotBlock(uint32_t block_num, char* buffer);
+
+    bool flush();                          // 写回所有未被 pin 的脏块并刷盘
+    bool refreshBlock(uint32_t block_num); // 重新从磁盘读取干净块（用于跨进程状态）
+    void discardBlock(uint32_t block_num); // 丢弃块（块被释放时调用，不写回）
+    void invalidate();                     // 丢弃全部缓存（格式化/挂载时调用）
+
+    BlockCacheStats getStats() const;
+    void resetStats();
+    uint32_t getCapacity() const { return capacity; }
+    uint32_t getDirtyCount() const;
+};
+
+#endif // BLOCKCACHE_H
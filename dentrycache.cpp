@@ -0,0 +1,64 @@
+#include "dentrycache.h"
+
+// ============= DentryCache 实现 =============
+
+DentryCache::DentryCache(uint32_t capacity)
+    : capacity(capacity == 0 ? 1 : capacity), hits(0), misses(0) {}
+
+bool DentryCache::lookup(uint32_t parent, const std::string& name, uint32_t& inode_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Key key = {parent, name};
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        misses++;
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    inode_id = it->second->second;
+    hits++;
+    return true;
+}
+
+void DentryCache::insert(uint32_t parent, const std::string& name, uint32_t inode_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Key key = {parent, name};
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        it->second->second = inode_id;
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+
+    if (entries.size() >= capacity) {
+        entries.erase(lru.back().first);
+        lru.pop_back();
+    }
+    lru.push_front(std::make_pair(key, inode_id));
+    entries[key] = lru.begin();
+}
+
+void DentryCache::remove(uint32_t parent, const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Key key = {parent, name};
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        lru.erase(it->second);
+        entries.erase(it);
+    }
+}
+
+void DentryCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    lru.clear();
+    entries.clear();
+}
+
+uint64_t DentryCache::getHits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+uint64_t DentryCache::getMisses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
@@ -0,0 +1,59 @@
+#ifndef DENTRYCACHE_H
+#define DENTRYCACHE_H
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// ============= 目录项缓存常量 =============
+const uint32_t DEFAULT_DENTRY_CACHE_SIZE = 4096;   // 默认缓存 4096 个目录项
+const uint32_t DENTRY_NEGATIVE = UINT32_MAX;       // 负项：名字在该目录中不存在
+
+// ============= 目录项缓存（LRU）=============
+// 缓存 (父目录 Inode, 文件名) -> 子 Inode 的查找结果，路径解析的每一级
+// 都是一次哈希查找，命中时不再读取目录块。
+// 查找失败的结果也作为负项缓存，反复访问不存在的名字同样不读盘。
+// 目录项增删时由 FileSystem 更新对应的缓存项。各操作由一把互斥锁保护。
+class DentryCache {
+private:
+    struct Key {
+        uint32_t parent;
+        std::string name;
+
+        bool operator==(const Key& other) const {
+            return parent == other.parent && name == other.name;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<std::string>()(key.name) ^ (static_cast<size_t>(key.parent) * 0x9e3779b97f4a7c15ULL);
+        }
+    };
+
+    typedef std::list<std::pair<Key, uint32_t>> LruList;
+
+    uint32_t capacity;
+    LruList lru;                // 表头为最近使用的项
+    std::unordered_map<Key, LruList::iterator, KeyHash> entries;
+    uint64_t hits;
+    uint64_t misses;
+    mutable std::mutex mutex;
+
+public:
+    DentryCache(uint32_t capacity = DEFAULT_DENTRY_CACHE_SIZE);
+
+    // 命中时返回 true，inode_id 可能为 DENTRY_NEGATIVE
+    bool lookup(uint32_t parent, const std::string& name, uint32_t& inode_id);
+    void insert(uint32_t parent, const std::string& name, uint32_t inode_id);
+    void remove(uint32_t parent, const std::string& name);
+    void clear();                // 格式化/挂载时调用
+
+    uint64_t getHits() const;
+    uint64_t getMisses() const;
+};
+
+#endif // DENTRYCACHE_H
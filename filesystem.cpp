@@ -1,119 +1,118 @@
 #include "filesystem.h"
+#include "blockcache.h"
+#include "inodecache.h"
+#include "dentrycache.h"
+#include "locktable.h"
+#include "journal.h"
 #include <iostream>
 #include <ctime>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <chrono>
 
-// ============= VirtualDisk 实现 =============
-
-VirtualDisk::VirtualDisk(const std::string& filename) : disk_filename(filename) {
-    disk_file.open(disk_filename, std::ios::in | std::ios::out | std::ios::binary);
-    if (!disk_file.is_open()) {
-        // 如果文件不存在，创建新文件
-        disk_file.open(disk_filename, std::ios::out | std::ios::binary);
-        if (disk_file.is_open()) {
-            // 创建空磁盘文件
-            char zero = 0;
-            for (uint32_t i = 0; i < DISK_SIZE; i++) {
-                disk_file.write(&zero, 1);
-            }
-            disk_file.close();
-            // 重新以读写方式打开
-            disk_file.open(disk_filename, std::ios::in | std::ios::out | std::ios::binary);
-        }
-    }
+// ============= FileSystem 实现 =============
+
+FileSystem::FileSystem(const std::string& disk_file, DiskBackend backend, bool direct_io) 
+    : group_count(0), spread_group(0), super_block_dirty(false),
+      commit_interval(1), pending_commits(0),
+      durability(DURABILITY_SYNC), flush_interval_ms(DEFAULT_FLUSH_INTERVAL_MS), flusher_stop(false),
+      lock_timeout_ms(DEFAULT_LOCK_TIMEOUT_MS), delayed_blocks(0) {
+    disk = VirtualDisk::create(disk_file, backend, direct_io);
+    cache = new BlockCache(disk);
+    journal = new Journal(disk, cache);
+    inode_cache = new InodeCache(cache, journal);
+    dentry_cache = new DentryCache();
+    lock_table = new LockTable(super_block.total_inodes);
 }
 
-VirtualDisk::~VirtualDisk() {
-    if (disk_file.is_open()) {
-        disk_file.close();
-    }
+FileSystem::~FileSystem() {
+    stopFlusher();
+    sync();          // 提交内存中的 Inode/位图/超级块并清空日志
+    delete lock_table;
+    delete dentry_cache;
+    delete inode_cache;
+    delete journal;
+    delete cache;    // 析构时写回所有脏块
+    delete disk;
 }
 
-bool VirtualDisk::format() {
-    if (!disk_file.is_open()) {
+bool FileSystem::format(uint64_t disk_size, uint32_t block_size, uint32_t inode_count) {
+    if (!disk->isOpen()) {
+        std::cerr << "错误：磁盘未打开" << std::endl;
         return false;
     }
     
-    disk_file.seekp(0);
-    char zero = 0;
-    for (uint32_t i = 0; i < DISK_SIZE; i++) {
-        disk_file.write(&zero, 1);
+    // 检查几何参数：块号为 32 位，Inode 表和日志之后至少要留下一些数据块
+    if (block_size != BLOCK_SIZE) {
+        std::cerr << "错误：目前只支持 " << BLOCK_SIZE << " 字节的块" << std::endl;
+        return false;
     }
-    disk_file.flush();
-    return true;
-}
-
-bool VirtualDisk::readBlock(uint32_t block_num, char* buffer) {
-    if (!disk_file.is_open() || block_num >= MAX_BLOCKS) {
+    if (disk_size == 0) {
+        disk_size = disk->getSize();
+    }
+    uint64_t total_blocks = disk_size / BLOCK_SIZE;
+    if (total_blocks > UINT32_MAX) {
+        std::cerr << "错误：磁盘过大（最多 " << UINT32_MAX << " 块）" << std::endl;
         return false;
     }
-    
-    disk_file.seekg(block_num * BLOCK_SIZE);
-    disk_file.read(buffer, BLOCK_SIZE);
-    return disk_file.good();
-}
-
-bool VirtualDisk::writeBlock(uint32_t block_num, const char* buffer) {
-    if (!disk_file.is_open() || block_num >= MAX_BLOCKS) {
+    if (inode_count == 0) {
+        inode_count = static_cast<uint32_t>(std::min<uint64_t>(
+            std::max<uint64_t>(disk_size / BYTES_PER_INODE, DEFAULT_INODES), MAX_INODES));
+    }
+    if (inode_count > MAX_INODES) {
+        std::cerr << "错误：Inode 数过多（最多 " << MAX_INODES << " 个）" << std::endl;
         return false;
     }
-    
-    disk_file.seekp(block_num * BLOCK_SIZE);
-    disk_file.write(buffer, BLOCK_SIZE);
-    disk_file.flush();
-    return disk_file.good();
-}
-
-bool VirtualDisk::isOpen() const {
-    return disk_file.is_open();
-}
-
-// ============= FileSystem 实现 =============
-
-FileSystem::FileSystem(const std::string& disk_file) 
-    : current_user(nullptr), current_dir_inode(0), current_path("/") {
-    disk = new VirtualDisk(disk_file);
-    inode_bitmap.resize(MAX_INODES, false);
-    data_bitmap.resize(MAX_BLOCKS, false);
-}
-
-FileSystem::~FileSystem() {
-    delete disk;
-}
-
-bool FileSystem::format() {
-    if (!disk->isOpen()) {
-        std::cerr << "错误：磁盘未打开" << std::endl;
+    // 按实际布局检查（日志区随磁盘大小伸缩），元数据之后至少要留下 MIN_DATA_BLOCKS 个数据块
+    SuperBlock layout(disk_size, inode_count);
+    if (static_cast<uint64_t>(layout.data_block_start) + MIN_DATA_BLOCKS > layout.total_blocks) {
+        std::cerr << "错误：磁盘太小：元数据占用 " << layout.data_block_start << " 块（Inode 表 "
+                  << layout.inodeTableBlocks() << " 块、日志 " << layout.journal_blocks << " 块），共 "
+                  << layout.total_blocks << " 块，数据区不足 " << MIN_DATA_BLOCKS << " 块" << std::endl;
         return false;
     }
+    stopFlusher();
     
-    // 格式化磁盘
-    if (!disk->format()) {
+    // 格式化磁盘：整个镜像调整到指定大小并以稀疏方式清空，数据区不再逐字节写零
+    if (!disk->format(layout.diskSize())) {
         std::cerr << "错误：磁盘格式化失败" << std::endl;
         return false;
     }
-    
-    // 初始化超级块
-    super_block = SuperBlock();
-    
+    cache->invalidate();
+    block_maps.clear();
+    delayed.clear();
+    delayed_blocks = 0;
+    dentry_cache->clear();
+
+    // 初始化超级块和空日志
+    super_block = layout;
+    if (!journal->format(super_block.journal_block, super_block.journal_blocks)) {
+        std::cerr << "错误：初始化日志失败" << std::endl;
+        return false;
+    }
+
+    // 镜像已清零：位图和 Inode 表无需整体写出，Inode 表按需读入，
+    // 提交时只写回被修改的块（超级块在下面写入）
+    if (!applyGeometry()) {
+        std::cerr << "错误：初始化 Inode 表失败" << std::endl;
+        return false;
+    }
+
     // 写入超级块
     char buffer[BLOCK_SIZE];
     memset(buffer, 0, BLOCK_SIZE);
     memcpy(buffer, &super_block, sizeof(SuperBlock));
-    if (!disk->writeBlock(0, buffer)) {
+    if (!cache->writeBlock(0, buffer)) {
         std::cerr << "错误：写入超级块失败" << std::endl;
         return false;
     }
     
-    // 初始化位图
-    std::fill(inode_bitmap.begin(), inode_bitmap.end(), false);
-    std::fill(data_bitmap.begin(), data_bitmap.end(), false);
-    
     // 根目录占用 Inode 0
-    inode_bitmap[0] = true;
-    super_block.free_inodes--;
+    countGroups();
+    inode_bitmap.set(0);
+    groups[0].free_inodes--;
+    groups[0].inode_bitmap_dirty = true;
     
     // 创建根目录 Inode
     Inode root_inode;
@@ -131,24 +130,26 @@ bool FileSystem::format() {
         return false;
     }
     
-    // 保存位图
-    if (!saveBitmaps()) {
-        std::cerr << "错误：保存位图失败" << std::endl;
-        return false;
-    }
-    
-    // 保存超级块
-    if (!saveSuperBlock()) {
-        std::cerr << "错误：保存超级块失败" << std::endl;
+    // 格式化结果立即刷盘
+    super_block_dirty = true;
+    if (!commit(true)) {
+        std::cerr << "错误：写回磁盘失败" << std::endl;
         return false;
     }
     
     // 初始化用户
-    users.clear();
+    {
+        std::lock_guard<std::mutex> lock(users_mutex);
+        users.clear();
+    }
     addUser("root", "root", true);
     addUser("user1", "123456", false);
     addUser("user2", "123456", false);
     
+    if (durability == DURABILITY_PERIODIC) {
+        startFlusher();
+    }
+    
     std::cout << "文件系统格式化成功！" << std::endl;
     return true;
 }
@@ -159,29 +160,77 @@ bool FileSystem::mount() {
         return false;
     }
     
+    // 先写回尚未提交的修改，再丢弃旧缓存，以磁盘上的内容为准
+    stopFlusher();
+    sync();
+    cache->invalidate();
+    block_maps.clear();
+    delayed.clear();
+    delayed_blocks = 0;
+    dentry_cache->clear();
+    
     if (!loadSuperBlock()) {
         std::cerr << "错误：加载超级块失败" << std::endl;
         return false;
     }
     
-    if (super_block.magic_number != 0x12345678) {
+    if (super_block.magic_number != FS_MAGIC) {
         std::cerr << "错误：无效的文件系统，请先格式化" << std::endl;
         return false;
     }
+    if (super_block.block_size != BLOCK_SIZE || super_block.total_blocks > disk->getBlockCount() ||
+        super_block.total_inodes > MAX_INODES) {
+        std::cerr << "错误：超级块与镜像大小不符" << std::endl;
+        return false;
+    }
+    if (super_block.blocks_per_group == 0) {
+        super_block.initGroups();      // 划分分配组之前格式化的镜像
+    }
+    
+    // 重放日志中已提交但可能未写回原位的事务，之后重新读取超级块
+    uint32_t replayed = 0;
+    if (!journal->recover(super_block.journal_block, super_block.journal_blocks, replayed)) {
+        std::cerr << "错误：日志恢复失败" << std::endl;
+        return false;
+    }
+    if (replayed > 0) {
+        cache->invalidate();
+        if (!loadSuperBlock()) {
+            std::cerr << "错误：加载超级块失败" << std::endl;
+            return false;
+        }
+        if (super_block.blocks_per_group == 0) {
+            super_block.initGroups();
+        }
+        std::cout << "日志恢复：重放了 " << replayed << " 个事务" << std::endl;
+    }
+    
+    // 按超级块中的几何参数调整位图、锁表和 Inode 表
+    if (!applyGeometry()) {
+        std::cerr << "错误：加载 Inode 表失败" << std::endl;
+        return false;
+    }
     
     if (!loadBitmaps()) {
         std::cerr << "错误：加载位图失败" << std::endl;
         return false;
     }
+    countGroups();
     
     // 初始化用户（实际项目中应该从磁盘读取）
-    users.clear();
+    {
+        std::lock_guard<std::mutex> lock(users_mutex);
+        users.clear();
+    }
     addUser("root", "root", true);
     addUser("user1", "123456", false);
     addUser("user2", "123456", false);
     
-    current_dir_inode = 0; // 根目录
-    current_path = "/";
+    // 按持久性模式决定刷盘是否等待落盘，以及是否启动后台刷盘
+    disk->setDurable(durability != DURABILITY_NONE);
+    if (durability == DURABILITY_PERIODIC) {
+        startFlusher();
+    }
     
     std::cout << "文件系统挂载成功！" << std::endl;
     return true;
@@ -189,257 +238,1714 @@ bool FileSystem::mount() {
 
 bool FileSystem::loadSuperBlock() {
     char buffer[BLOCK_SIZE];
-    if (!disk->readBlock(0, buffer)) {
+    if (!cache->readBlock(0, buffer)) {
+        return false;
+    }
+    memcpy(&super_block, buffer, sizeof(SuperBlock));
+    return true;
+}
+
+bool FileSystem::applyGeometry() {
+    // 位图、分配组、锁表和 Inode 缓存的大小都取自超级块（格式化或挂载时调用，此时没有其他操作）
+    if (static_cast<uint64_t>(super_block.blocks_per_group) * super_block.group_count < super_block.total_blocks ||
+        static_cast<uint64_t>(super_block.inodes_per_group) * super_block.group_count < super_block.total_inodes ||
+        super_block.blocks_per_group % 64 != 0 || super_block.inodes_per_group % 64 != 0) {
+        std::cerr << "错误：超级块中的分配组参数无效" << std::endl;
+        return false;
+    }
+    inode_bitmap.resize(super_block.total_inodes);
+    data_bitmap.resize(super_block.total_blocks);
+    
+    group_count = super_block.group_count;
+    groups.reset(new AllocGroup[group_count]);
+    for (uint32_t i = 0; i < group_count; i++) {
+        AllocGroup& group = groups[i];
+        uint64_t first_block = static_cast<uint64_t>(i) * super_block.blocks_per_group;
+        uint64_t first_inode = static_cast<uint64_t>(i) * super_block.inodes_per_group;
+        group.end_block = static_cast<uint32_t>(std::min<uint64_t>(first_block + super_block.blocks_per_group,
+                                                                   super_block.total_blocks));
+        group.first_block = std::min(std::max(static_cast<uint32_t>(first_block), super_block.data_block_start),
+                                     group.end_block);  // 元数据区不参与分配
+        group.end_inode = static_cast<uint32_t>(std::min<uint64_t>(first_inode + super_block.inodes_per_group,
+                                                                   super_block.total_inodes));
+        group.first_inode = std::min(static_cast<uint32_t>(first_inode), group.end_inode);
+        group.block_cursor = group.first_block;
+        group.inode_cursor = group.first_inode;
+    }
+    
+    delete lock_table;
+    lock_table = new LockTable(super_block.total_inodes);
+    return inode_cache->load(super_block.inode_table_block, super_block.total_inodes);
+}
+
+bool FileSystem::saveSuperBlock() {
+    char buffer[BLOCK_SIZE];
+    memset(buffer, 0, BLOCK_SIZE);
+    memcpy(buffer, &super_block, sizeof(SuperBlock));
+    journal->addBlock(0, false);
+    return cache->writeBlock(0, buffer);
+}
+
+bool FileSystem::syncMetadata() {
+    // 先为延迟分配的数据分配块（会修改 Inode、位图和 extent 块），
+    // 再只写回含有脏 Inode 的 Inode 表块、被修改过的位图块和超级块
+    bool ok = flushDelayed();
+    if (!inode_cache->flush()) {
+        ok = false;
+    }
+    if (!saveBitmaps()) {
+        ok = false;
+    }
+    
+    // 超级块中的空闲计数由各组汇总，有变化时才写回（尚未挂载时没有分配组）
+    uint32_t free_blocks = 0;
+    uint32_t free_inodes = 0;
+    for (uint32_t i = 0; i < group_count; i++) {
+        free_blocks += groups[i].free_blocks;
+        free_inodes += groups[i].free_inodes;
+    }
+    if (group_count > 0 &&
+        (free_blocks != super_block.free_blocks || free_inodes != super_block.free_inodes)) {
+        super_block.free_blocks = free_blocks;
+        super_block.free_inodes = free_inodes;
+        super_block_dirty = true;
+    }
+    if (super_block_dirty) {
+        if (saveSuperBlock()) {
+            super_block_dirty = false;
+        } else {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool FileSystem::commit(bool force) {
+    uint64_t tid = journal->endUpdate();
+    std::lock_guard<std::mutex> guard(commit_mutex);
+    // 等待提交锁期间，其他线程的提交可能已把本操作所在的事务一并写入（组提交）
+    if (journal->isCommitted(tid)) {
+        return true;
+    }
+    // 未到提交间隔时修改留在当前事务中，由之后的提交点统一写入日志；
+    // periodic 和 none 模式下由后台线程或 sync 提交，日志将满时才就地提交
+    pending_commits++;
+    bool deferred = durability != DURABILITY_SYNC || pending_commits < commit_interval;
+    if (!force && deferred && !journal->isFull()) {
+        return true;
+    }
+    pending_commits = 0;
+
+    // 等进行中的修改结束后把内存中的元数据写入块缓存，再作为一个事务提交
+    journal->lockUpdates();
+    bool ok = syncMetadata();
+    return journal->commit() && ok;
+}
+
+bool FileSystem::sync() {
+    bool ok = commit(true);
+    std::lock_guard<std::mutex> guard(commit_mutex);
+    return journal->checkpoint() && ok;
+}
+
+void FileSystem::setCommitInterval(uint32_t operations) {
+    commit_interval = operations == 0 ? 1 : operations;
+}
+
+void FileSystem::setDurability(DurabilityMode mode, uint32_t interval_ms) {
+    durability = mode;
+    flush_interval_ms = interval_ms == 0 ? 1 : interval_ms;
+}
+
+void FileSystem::startFlusher() {
+    std::lock_guard<std::mutex> lock(flusher_mutex);
+    flusher_stop = false;
+    flusher = std::thread(&FileSystem::flusherLoop, this);
+}
+
+void FileSystem::stopFlusher() {
+    {
+        std::lock_guard<std::mutex> lock(flusher_mutex);
+        flusher_stop = true;
+    }
+    flusher_cv.notify_all();
+    if (flusher.joinable()) {
+        flusher.join();
+    }
+}
+
+void FileSystem::flusherLoop() {
+    // 每个周期提交一次：期间的全部修改合为一个日志事务，只做一次 fdatasync
+    std::unique_lock<std::mutex> lock(flusher_mutex);
+    while (!flusher_cv.wait_for(lock, std::chrono::milliseconds(flush_interval_ms),
+                                [this] { return flusher_stop; })) {
+        lock.unlock();
+        bool pending;
+        {
+            std::lock_guard<std::mutex> guard(commit_mutex);
+            pending = pending_commits > 0;
+        }
+        if (pending) {
+            commit(true);
+        }
+        lock.lock();
+    }
+}
+
+bool FileSystem::loadBitmaps() {
+    return loadBitmap(inode_bitmap, super_block.inode_bitmap_block) &&
+           loadBitmap(data_bitmap, super_block.data_bitmap_block);
+}
+
+bool FileSystem::saveBitmaps() {
+    // 收集位图段被修改过的组所在的位图块
+    std::set<uint32_t> inode_blocks;
+    std::set<uint32_t> data_blocks;
+    for (uint32_t i = 0; i < group_count; i++) {
+        AllocGroup& group = groups[i];
+        std::lock_guard<std::mutex> guard(group.mutex);
+        if (group.inode_bitmap_dirty) {
+            markBitmapDirty(inode_blocks, group.first_inode, group.end_inode - group.first_inode);
+            group.inode_bitmap_dirty = false;
+        }
+        if (group.block_bitmap_dirty) {
+            markBitmapDirty(data_blocks, group.first_block, group.end_block - group.first_block);
+            group.block_bitmap_dirty = false;
+        }
+    }
+    return saveBitmap(inode_bitmap, super_block.inode_bitmap_block, inode_blocks, super_block.inodes_per_group) &&
+           saveBitmap(data_bitmap, super_block.data_bitmap_block, data_blocks, super_block.blocks_per_group);
+}
+
+bool FileSystem::loadBitmap(Bitmap& bitmap, uint32_t start_block) {
+    // 磁盘格式与内存中的字数组一致：多块位图一次批量读入后直接拷贝
+    uint32_t count = bitmapBlocks(static_cast<uint32_t>(bitmap.size()));
+    std::vector<char> data(static_cast<size_t>(count) * BLOCK_SIZE);
+    std::vector<uint32_t> blocks(count);
+    std::vector<char*> buffers(count);
+    for (uint32_t i = 0; i < count; i++) {
+        blocks[i] = start_block + i;
+        buffers[i] = data.data() + static_cast<size_t>(i) * BLOCK_SIZE;
+    }
+    if (!cache->readBlocks(blocks.data(), buffers.data(), count)) {
+        return false;
+    }
+    bitmap.load(data.data(), data.size());
+    return true;
+}
+
+bool FileSystem::saveBitmap(const Bitmap& bitmap, uint32_t start_block, const std::set<uint32_t>& blocks,
+                            uint32_t group_bits) {
+    // 只写回被修改过的位图块；一个位图块可能由几个小分配组共用，
+    // 复制时按组号递增锁住这些组，得到一致的映像
+    char buffer[BLOCK_SIZE];
+    for (uint32_t index : blocks) {
+        uint64_t first_bit = static_cast<uint64_t>(index) * BITS_PER_BLOCK;
+        uint32_t first = static_cast<uint32_t>(first_bit / group_bits);
+        uint32_t last = static_cast<uint32_t>(std::min<uint64_t>((first_bit + BITS_PER_BLOCK - 1) / group_bits,
+                                                                 group_count - 1));
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (uint32_t i = first; i <= last; i++) {
+            locks.emplace_back(groups[i].mutex);
+        }
+        bitmap.store(buffer, BLOCK_SIZE, static_cast<size_t>(index) * BLOCK_SIZE);
+        locks.clear();
+        
+        journal->addBlock(start_block + index, false);
+        if (!cache->writeBlock(start_block + index, buffer)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FileSystem::markBitmapDirty(std::set<uint32_t>& blocks, uint32_t first, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    uint32_t last = first + count - 1;
+    for (uint32_t index = first / BITS_PER_BLOCK; index <= last / BITS_PER_BLOCK; index++) {
+        blocks.insert(index);
+    }
+}
+
+void FileSystem::countGroups() {
+    for (uint32_t i = 0; i < group_count; i++) {
+        AllocGroup& group = groups[i];
+        std::lock_guard<std::mutex> guard(group.mutex);
+        group.free_blocks = group.end_block - group.first_block -
+                            data_bitmap.count(group.first_block, group.end_block);
+        group.free_inodes = group.end_inode - group.first_inode -
+                            inode_bitmap.count(group.first_inode, group.end_inode);
+        group.block_bitmap_dirty = false;
+        group.inode_bitmap_dirty = false;
+    }
+}
+
+uint32_t FileSystem::findInodeGroup(uint32_t parent_id, bool directory) {
+    uint32_t parent_group = parent_id / super_block.inodes_per_group;
+    uint64_t free_inodes = 0;
+    uint64_t free_blocks = 0;
+    for (uint32_t i = 0; i < group_count; i++) {
+        free_inodes += groups[i].free_inodes;
+        free_blocks += groups[i].free_blocks;
+    }
+    uint32_t average_inodes = static_cast<uint32_t>(free_inodes / group_count);
+    uint32_t average_blocks = static_cast<uint32_t>(free_blocks / group_count);
+    
+    // 空闲计数是无锁读取的近似值，选中的组在加锁分配时可能已经用完，由调用者继续向后找
+    if (directory && parent_id == 0) {
+        // 根目录下的目录（通常是互不相关的目录树）从轮转的起点开始，
+        // 分散到空闲 Inode 和空闲块都不少于平均值的组
+        uint32_t start = spread_group++ % group_count;
+        for (uint32_t i = 0; i < group_count; i++) {
+            AllocGroup& group = groups[(start + i) % group_count];
+            if (group.free_inodes > 0 && group.free_inodes >= average_inodes &&
+                group.free_blocks >= average_blocks) {
+                return (start + i) % group_count;
+            }
+        }
+    } else if (directory) {
+        // 其他目录留在父目录附近，除非那里的空闲块已远少于平均值
+        for (uint32_t i = 0; i < group_count; i++) {
+            AllocGroup& group = groups[(parent_group + i) % group_count];
+            if (group.free_inodes > 0 && group.free_blocks >= average_blocks / 4) {
+                return (parent_group + i) % group_count;
+            }
+        }
+    } else {
+        // 普通文件放在父目录所在的组（同目录的文件彼此靠近），该组没有空闲块时顺延
+        for (uint32_t i = 0; i < group_count; i++) {
+            AllocGroup& group = groups[(parent_group + i) % group_count];
+            if (group.free_inodes > 0 && group.free_blocks > 0) {
+                return (parent_group + i) % group_count;
+            }
+        }
+    }
+    return parent_group;
+}
+
+uint32_t FileSystem::allocateInode(uint32_t parent_id, bool directory) {
+    // 从选定的组开始依次尝试，每次只锁一个组
+    uint32_t start = findInodeGroup(parent_id, directory);
+    for (uint32_t i = 0; i < group_count; i++) {
+        AllocGroup& group = groups[(start + i) % group_count];
+        if (group.free_inodes == 0) {
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(group.mutex);
+        uint32_t inode_id = inode_bitmap.allocate(group.first_inode, group.end_inode, group.inode_cursor);
+        if (inode_id != UINT32_MAX) {
+            group.free_inodes--;
+            group.inode_bitmap_dirty = true;
+            return inode_id;
+        }
+    }
+    return UINT32_MAX; // 没有空闲 Inode
+}
+
+void FileSystem::freeInode(uint32_t inode_id) {
+    if (inode_id >= super_block.total_inodes) {
+        return;
+    }
+    AllocGroup& group = groupOfInode(inode_id);
+    std::lock_guard<std::mutex> guard(group.mutex);
+    if (inode_bitmap.test(inode_id)) {
+        inode_bitmap.clear(inode_id);
+        group.free_inodes++;
+        group.inode_bitmap_dirty = true;
+    }
+}
+
+bool FileSystem::inodeInUse(uint32_t inode_id) {
+    if (inode_id >= super_block.total_inodes) {
+        return false;
+    }
+    AllocGroup& group = groupOfInode(inode_id);
+    std::lock_guard<std::mutex> guard(group.mutex);
+    return inode_bitmap.test(inode_id);
+}
+
+uint32_t FileSystem::allocateDataBlock(uint32_t inode_id) {
+    uint32_t start = inode_id / super_block.inodes_per_group;
+    for (uint32_t i = 0; i < group_count; i++) {
+        AllocGroup& group = groups[(start + i) % group_count];
+        if (group.free_blocks == 0) {
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(group.mutex);
+        uint32_t block_id = data_bitmap.allocate(group.first_block, group.end_block, group.block_cursor);
+        if (block_id != UINT32_MAX) {
+            group.free_blocks--;
+            group.block_bitmap_dirty = true;
+            return block_id;
+        }
+    }
+    return UINT32_MAX; // 没有空闲数据块
+}
+
+bool FileSystem::allocateExtents(uint32_t inode_id, uint32_t count, std::vector<Extent>& extents) {
+    // 延迟分配预留的块留给尾部缓冲，提交时一定能分配到
+    if (count + static_cast<uint64_t>(delayed_blocks) > freeBlockCount()) {
+        return false;
+    }
+    size_t first_new = extents.size();
+    uint32_t allocated = 0;
+    uint32_t extended = 0;  // 直接延长到原最后一个 extent 上的块数
+    
+    // 追加时优先紧接在原最后一个 extent 之后分配，文件保持连续（不跨出该组）；
+    // 新文件从其 Inode 所在的组开始
+    uint32_t start_group = inode_id / super_block.inodes_per_group;
+    if (!extents.empty()) {
+        Extent& last = extents.back();
+        uint32_t next = last.start_block + last.length;
+        if (next < super_block.total_blocks) {
+            AllocGroup& group = groupOfBlock(next);
+            std::lock_guard<std::mutex> guard(group.mutex);
+            if (next >= group.first_block) {
+                extended = data_bitmap.allocateAt(next, count, group.end_block);
+            }
+            if (extended > 0) {
+                last.length += extended;
+                allocated = extended;
+                group.free_blocks -= extended;
+                group.block_bitmap_dirty = true;
+            }
+        }
+        start_group = std::min(last.start_block + last.length, super_block.total_blocks - 1) /
+                      super_block.blocks_per_group;
+    }
+    
+    // 优先把剩余部分整段分配在某一个组中，使文件数据可以合并为一次顺序 I/O；
+    // 没有足够长的空闲区间时，从起始组开始逐组取下一段空闲区间中尽可能多的块
+    for (int pass = 0; pass < 2 && allocated < count; pass++) {
+        for (uint32_t i = 0; i < group_count && allocated < count; i++) {
+            AllocGroup& group = groups[(start_group + i) % group_count];
+            uint32_t remaining = count - allocated;
+            if (group.free_blocks == 0 || (pass == 0 && group.free_blocks < remaining)) {
+                continue;
+            }
+            
+            std::lock_guard<std::mutex> guard(group.mutex);
+            while (allocated < count) {
+                remaining = count - allocated;
+                uint32_t length = remaining;
+                uint32_t start;
+                if (pass == 0) {
+                    start = data_bitmap.allocateRun(remaining, group.first_block, group.end_block,
+                                                    group.block_cursor);
+                } else {
+                    start = data_bitmap.allocateUpTo(remaining, group.first_block, group.end_block,
+                                                     group.block_cursor, length);
+                }
+                if (start == UINT32_MAX) {
+                    break;
+                }
+                group.free_blocks -= length;
+                group.block_bitmap_dirty = true;
+                allocated += length;
+                
+                if (extents.size() > first_new &&
+                    extents.back().start_block + extents.back().length == start) {
+                    extents.back().length += length;
+                } else {
+                    Extent extent;
+                    extent.start_block = start;
+                    extent.length = length;
+                    extents.push_back(extent);
+                }
+            }
+        }
+    }
+    
+    if (allocated < count) {
+        // 空间不足：回滚本次分配的区间
+        for (size_t i = first_new; i < extents.size(); i++) {
+            releaseBlocks(extents[i].start_block, extents[i].length);
+        }
+        extents.resize(first_new);
+        if (extended > 0) {
+            Extent& last = extents.back();
+            last.length -= extended;
+            releaseBlocks(last.start_block + last.length, extended);
+        }
+        return false;
+    }
+    return true;
+}
+
+void FileSystem::freeExtent(const Extent& extent) {
+    releaseBlocks(extent.start_block, extent.length);
+}
+
+void FileSystem::freeDataBlock(uint32_t block_id) {
+    releaseBlocks(block_id, 1);
+}
+
+void FileSystem::releaseBlocks(uint32_t start, uint32_t count) {
+    // 区间可能跨越组边界（相邻组中的区间合并而成），按组分段加锁
+    uint64_t end = std::min<uint64_t>(static_cast<uint64_t>(start) + count, super_block.total_blocks);
+    while (start < end) {
+        AllocGroup& group = groupOfBlock(start);
+        uint32_t segment_end = static_cast<uint32_t>(std::min<uint64_t>(end, group.end_block));
+        std::lock_guard<std::mutex> guard(group.mutex);
+        for (uint32_t block_id = start; block_id < segment_end; block_id++) {
+            if (block_id >= group.first_block && data_bitmap.test(block_id)) {
+                data_bitmap.clear(block_id);
+                journal->revokeBlock(block_id);  // 日志中的旧映像不再重放
+                cache->discardBlock(block_id);   // 已释放的块无需写回
+                group.free_blocks++;
+                group.block_bitmap_dirty = true;
+            }
+        }
+        start = segment_end;
+    }
+}
+
+uint64_t FileSystem::freeBlockCount() {
+    uint64_t free_blocks = 0;
+    for (uint32_t i = 0; i < group_count; i++) {
+        free_blocks += groups[i].free_blocks;
+    }
+    return free_blocks;
+}
+
+bool FileSystem::readInode(uint32_t inode_id, Inode& inode) {
+    // Inode 表常驻内存，读取只是一次拷贝
+    return inode_cache->read(inode_id, inode);
+}
+
+bool FileSystem::writeInode(uint32_t inode_id, const Inode& inode) {
+    // 只修改内存副本并标脏，提交时按整块批量写回
+    return inode_cache->write(inode_id, inode);
+}
+
+bool FileSystem::reloadInode(uint32_t inode_id, Inode& inode) {
+    // 其他进程可能修改了文件，先用磁盘内容刷新内存中的干净副本
+    Inode cached;
+    if (!readInode(inode_id, cached) || !inode_cache->refresh(inode_id) ||
+        !readInode(inode_id, inode)) {
+        return false;
+    }
+    // 写入计数变化说明其他进程写过该文件，本进程缓存的映射块和数据块都可能过期
+    if (inode.generation != cached.generation) {
+        return refreshInodeBlocks(inode);
+    }
+    return true;
+}
+
+bool FileSystem::refreshInodeBlocks(const Inode& inode) {
+    invalidateBlockMap(inode.inode_id);
+    
+    // 先刷新 extent 溢出块和索引块，再按最新映射刷新各级 extent 块和数据块
+    if (inode.extent_block != 0 && !cache->refreshBlock(inode.extent_block)) {
+        return false;
+    }
+    if (inode.extent_index_block != 0) {
+        if (!cache->refreshBlock(inode.extent_index_block)) {
+            return false;
+        }
+        const char* block = cache->pinBlock(inode.extent_index_block);
+        if (!block) {
+            return false;
+        }
+        std::vector<uint32_t> index(INDEX_ENTRIES);
+        memcpy(index.data(), block, INDEX_ENTRIES * sizeof(uint32_t));
+        cache->unpinBlock(inode.extent_index_block, false);
+        for (uint32_t leaf : index) {
+            if (leaf != 0 && !cache->refreshBlock(leaf)) {
+                return false;
+            }
+        }
+    }
+    
+    std::vector<uint32_t> blocks;
+    if (!mapInodeBlocks(inode, blocks)) {
+        return false;
+    }
+    for (uint32_t block_num : blocks) {
+        if (!cache->refreshBlock(block_num)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileSystem::readExtentBlock(uint32_t block_num, uint32_t count, std::vector<Extent>& extents) {
+    const char* block = cache->pinBlock(block_num);
+    if (!block) {
+        return false;
+    }
+    const Extent* stored = reinterpret_cast<const Extent*>(block);
+    extents.insert(extents.end(), stored, stored + count);
+    cache->unpinBlock(block_num, false);
+    return true;
+}
+
+bool FileSystem::writeMetadataBlock(uint32_t inode_id, uint32_t& block_num, const void* data, size_t bytes) {
+    if (block_num == 0) {
+        block_num = allocateDataBlock(inode_id);
+        if (block_num == UINT32_MAX) {
+            block_num = 0;
+            std::cerr << "错误：磁盘空间不足" << std::endl;
+            return false;
+        }
+    }
+    journal->addBlock(block_num, false);
+    char* block = cache->pinBlock(block_num, false);
+    if (!block) {
+        return false;
+    }
+    memset(block, 0, BLOCK_SIZE);
+    memcpy(block, data, bytes);
+    cache->unpinBlock(block_num, true);
+    return true;
+}
+
+bool FileSystem::loadExtents(const Inode& inode, std::vector<Extent>& extents) {
+    extents.clear();
+    uint32_t count = inode.extent_count;
+    uint32_t inline_count = std::min(count, INLINE_EXTENTS);
+    extents.insert(extents.end(), inode.extents, inode.extents + inline_count);
+    
+    // 一级溢出块
+    if (count <= INLINE_EXTENTS) {
+        return true;
+    }
+    uint32_t overflow_count = std::min(count - INLINE_EXTENTS, EXTENTS_PER_BLOCK);
+    if (inode.extent_block == 0 || !readExtentBlock(inode.extent_block, overflow_count, extents)) {
         return false;
     }
-    memcpy(&super_block, buffer, sizeof(SuperBlock));
+    
+    // 二级索引块：依次读取其中记录的各个 extent 块
+    uint32_t rest = count - INLINE_EXTENTS - overflow_count;
+    if (rest == 0) {
+        return true;
+    }
+    if (inode.extent_index_block == 0) {
+        return false;
+    }
+    std::vector<uint32_t> index(INDEX_ENTRIES);
+    const char* block = cache->pinBlock(inode.extent_index_block);
+    if (!block) {
+        return false;
+    }
+    memcpy(index.data(), block, INDEX_ENTRIES * sizeof(uint32_t));
+    cache->unpinBlock(inode.extent_index_block, false);
+    
+    for (uint32_t i = 0; rest > 0; i++) {
+        uint32_t leaf_count = std::min(rest, EXTENTS_PER_BLOCK);
+        if (i >= INDEX_ENTRIES || index[i] == 0 || !readExtentBlock(index[i], leaf_count, extents)) {
+            return false;
+        }
+        rest -= leaf_count;
+    }
+    return true;
+}
+
+bool FileSystem::storeExtents(Inode& inode, const std::vector<Extent>& extents) {
+    if (extents.size() > MAX_EXTENTS) {
+        std::cerr << "错误：文件碎片过多" << std::endl;
+        return false;
+    }
+    invalidateBlockMap(inode.inode_id);
+    
+    uint32_t count = static_cast<uint32_t>(extents.size());
+    uint32_t inline_count = std::min(count, INLINE_EXTENTS);
+    memset(inode.extents, 0, sizeof(inode.extents));
+    std::copy(extents.begin(), extents.begin() + inline_count, inode.extents);
+    
+    // 内联放不下的部分写入一级溢出块，不再需要时释放
+    uint32_t overflow_count = count > INLINE_EXTENTS ?
+        std::min(count - INLINE_EXTENTS, EXTENTS_PER_BLOCK) : 0;
+    if (overflow_count > 0) {
+        if (!writeMetadataBlock(inode.inode_id, inode.extent_block, &extents[INLINE_EXTENTS],
+                                overflow_count * sizeof(Extent))) {
+            return false;
+        }
+    } else if (inode.extent_block != 0) {
+        freeDataBlock(inode.extent_block);
+        inode.extent_block = 0;
+    }
+    
+    // 再放不下的部分按 EXTENTS_PER_BLOCK 分组写入二级 extent 块，多余的旧块释放
+    uint32_t rest = count - inline_count - overflow_count;
+    uint32_t leaves = (rest + EXTENTS_PER_BLOCK - 1) / EXTENTS_PER_BLOCK;
+    std::vector<uint32_t> index(INDEX_ENTRIES, 0);
+    if (inode.extent_index_block != 0) {
+        const char* block = cache->pinBlock(inode.extent_index_block);
+        if (!block) {
+            return false;
+        }
+        memcpy(index.data(), block, INDEX_ENTRIES * sizeof(uint32_t));
+        cache->unpinBlock(inode.extent_index_block, false);
+    }
+    
+    const Extent* next = extents.data() + inline_count + overflow_count;
+    for (uint32_t i = 0; i < leaves; i++) {
+        uint32_t leaf_count = std::min(rest - i * EXTENTS_PER_BLOCK, EXTENTS_PER_BLOCK);
+        if (!writeMetadataBlock(inode.inode_id, index[i], next + i * EXTENTS_PER_BLOCK, leaf_count * sizeof(Extent))) {
+            return false;
+        }
+    }
+    for (uint32_t i = leaves; i < INDEX_ENTRIES; i++) {
+        if (index[i] != 0) {
+            freeDataBlock(index[i]);
+            index[i] = 0;
+        }
+    }
+    
+    if (leaves > 0) {
+        if (!writeMetadataBlock(inode.inode_id, inode.extent_index_block, index.data(),
+                                INDEX_ENTRIES * sizeof(uint32_t))) {
+            return false;
+        }
+    } else if (inode.extent_index_block != 0) {
+        freeDataBlock(inode.extent_index_block);
+        inode.extent_index_block = 0;
+    }
+    
+    inode.extent_count = static_cast<uint16_t>(count);
+    inode.blocks_count = 0;
+    for (const auto& extent : extents) {
+        inode.blocks_count += extent.length;
+    }
+    return true;
+}
+
+bool FileSystem::mapInodeBlocks(const Inode& inode, std::vector<uint32_t>& blocks) {
+    std::vector<Extent> extents;
+    if (!loadExtents(inode, extents)) {
+        return false;
+    }
+    blocks.clear();
+    blocks.reserve(inode.blocks_count);
+    for (const auto& extent : extents) {
+        for (uint32_t i = 0; i < extent.length; i++) {
+            blocks.push_back(extent.start_block + i);
+        }
+    }
+    return true;
+}
+
+// 两个 Inode 的 extent 映射字段是否相同（相同则缓存的映射表仍然有效）
+static bool sameMapping(const Inode& a, const Inode& b) {
+    return a.extent_count == b.extent_count &&
+           a.blocks_count == b.blocks_count &&
+           a.extent_block == b.extent_block &&
+           a.extent_index_block == b.extent_index_block &&
+           memcmp(a.extents, b.extents, sizeof(a.extents)) == 0;
+}
+
+FileSystem::BlockMapRef FileSystem::getBlockMap(const Inode& inode) {
+    {
+        std::lock_guard<std::mutex> guard(block_maps_mutex);
+        auto it = block_maps.find(inode.inode_id);
+        if (it != block_maps.end() && sameMapping(it->second.source, inode)) {
+            return it->second.blocks;
+        }
+    }
+    
+    // 读取 extent 块可能访问磁盘，在锁外进行
+    std::shared_ptr<std::vector<uint32_t>> blocks = std::make_shared<std::vector<uint32_t>>();
+    if (!mapInodeBlocks(inode, *blocks)) {
+        return BlockMapRef();
+    }
+    std::lock_guard<std::mutex> guard(block_maps_mutex);
+    if (block_maps.find(inode.inode_id) == block_maps.end() &&
+        block_maps.size() >= BLOCK_MAP_CACHE_SIZE) {
+        block_maps.erase(block_maps.begin());
+    }
+    BlockMap& entry = block_maps[inode.inode_id];
+    entry.source = inode;
+    entry.blocks = blocks;
+    return blocks;
+}
+
+uint32_t FileSystem::lookupBlock(const Inode& inode, uint32_t logical_block) {
+    BlockMapRef blocks = getBlockMap(inode);
+    if (!blocks || logical_block >= blocks->size()) {
+        return UINT32_MAX;
+    }
+    return (*blocks)[logical_block];
+}
+
+void FileSystem::invalidateBlockMap(uint32_t inode_id) {
+    std::lock_guard<std::mutex> guard(block_maps_mutex);
+    block_maps.erase(inode_id);
+}
+
+void FileSystem::freeInodeBlocks(Inode& inode) {
+    invalidateBlockMap(inode.inode_id);
+    dropDelayed(inode.inode_id);  // 尚未分配块的尾部只需丢弃
+    
+    std::vector<Extent> extents;
+    if (loadExtents(inode, extents)) {
+        for (const auto& extent : extents) {
+            freeExtent(extent);
+        }
+    }
+    if (inode.extent_block != 0) {
+        freeDataBlock(inode.extent_block);
+    }
+    if (inode.extent_index_block != 0) {
+        const char* block = cache->pinBlock(inode.extent_index_block);
+        if (block) {
+            std::vector<uint32_t> index(INDEX_ENTRIES);
+            memcpy(index.data(), block, INDEX_ENTRIES * sizeof(uint32_t));
+            cache->unpinBlock(inode.extent_index_block, false);
+            for (uint32_t leaf : index) {
+                if (leaf != 0) {
+                    freeDataBlock(leaf);
+                }
+            }
+        }
+        freeDataBlock(inode.extent_index_block);
+    }
+    inode.extent_count = 0;
+    memset(inode.extents, 0, sizeof(inode.extents));
+    inode.extent_block = 0;
+    inode.extent_index_block = 0;
+    inode.blocks_count = 0;
+}
+
+// 把 extents 截断为前 keep_blocks 个逻辑块，截掉的部分追加到 removed
+static void splitExtents(std::vector<Extent>& extents, uint32_t keep_blocks,
+                         std::vector<Extent>& removed) {
+    uint32_t covered = 0;
+    size_t i = 0;
+    while (i < extents.size() && covered + extents[i].length <= keep_blocks) {
+        covered += extents[i].length;
+        i++;
+    }
+    if (i < extents.size() && covered < keep_blocks) {
+        // 区间跨越截断点：前半保留，后半移除
+        uint32_t keep = keep_blocks - covered;
+        Extent tail;
+        tail.start_block = extents[i].start_block + keep;
+        tail.length = extents[i].length - keep;
+        removed.push_back(tail);
+        extents[i].length = keep;
+        i++;
+    }
+    removed.insert(removed.end(), extents.begin() + i, extents.end());
+    extents.resize(i);
+}
+
+bool FileSystem::growInode(Inode& inode, uint32_t block_count) {
+    std::vector<Extent> extents;
+    if (!loadExtents(inode, extents)) {
+        return false;
+    }
+    
+    // 新块紧接在最后一个 extent 之后时直接延长该 extent
+    uint32_t old_blocks = inode.blocks_count;
+    if (!allocateExtents(inode.inode_id, block_count, extents)) {
+        std::cerr << "错误：磁盘空间不足" << std::endl;
+        return false;
+    }
+    if (!storeExtents(inode, extents)) {
+        std::vector<Extent> added;
+        splitExtents(extents, old_blocks, added);
+        for (const auto& extent : added) {
+            freeExtent(extent);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool FileSystem::bufferTail(Inode& inode, uint32_t size, uint32_t offset, const char* data,
+                            uint32_t length) {
+    uint32_t allocated = inode.blocks_count * BLOCK_SIZE;
+    uint32_t blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE - inode.blocks_count;
+    if (blocks > DELAYED_FILE_BLOCKS) {
+        return false;
+    }
+    
+    std::shared_ptr<DelayedTail> tail;
+    {
+        std::lock_guard<std::mutex> guard(delayed_mutex);
+        auto it = delayed.find(inode.inode_id);
+        if (it != delayed.end()) {
+            tail = it->second;
+        }
+    }
+    uint32_t held = tail ? static_cast<uint32_t>(tail->data.size() / BLOCK_SIZE) : 0;
+    
+    // 只预留空间、不选块号：预留计数不超过空闲块数，空间不足在写入时就能报告
+    if (blocks > held) {
+        uint32_t needed = blocks - held;
+        uint32_t reserved = delayed_blocks;
+        do {
+            if (reserved + needed > DELAYED_TOTAL_BLOCKS) {
+                return false;
+            }
+            if (reserved + needed > freeBlockCount()) {
+                return false;
+            }
+        } while (!delayed_blocks.compare_exchange_weak(reserved, reserved + needed));
+    } else {
+        delayed_blocks -= held - blocks;
+    }
+    
+    if (!tail) {
+        tail = std::make_shared<DelayedTail>();
+        std::lock_guard<std::mutex> guard(delayed_mutex);
+        delayed[inode.inode_id] = tail;
+    }
+    // 扩大的部分补零；缩小时保持"文件末尾之后的块内字节为 0"
+    tail->data.resize(static_cast<size_t>(blocks) * BLOCK_SIZE, 0);
+    memset(tail->data.data() + (size - allocated), 0, tail->data.size() - (size - allocated));
+    if (length > 0) {
+        memcpy(tail->data.data() + (offset - allocated), data, length);
+    }
+    inode.file_size = size;
+    return true;
+}
+
+bool FileSystem::allocateDelayed(Inode& inode, bool publish) {
+    if (delayed_blocks == 0) {
+        return true;
+    }
+    std::shared_ptr<DelayedTail> tail;
+    {
+        std::lock_guard<std::mutex> guard(delayed_mutex);
+        auto it = delayed.find(inode.inode_id);
+        if (it == delayed.end()) {
+            return true;
+        }
+        tail = it->second;
+    }
+    
+    // 整个尾部一次分配：分配器看到最终大小，可以给出一段连续的块。
+    // 先归还预留，由这次分配真正占用
+    uint32_t count = static_cast<uint32_t>(tail->data.size() / BLOCK_SIZE);
+    uint32_t old_blocks = inode.blocks_count;
+    delayed_blocks -= count;
+    if (!growInode(inode, count)) {
+        delayed_blocks += count;
+        return false;
+    }
+    BlockMapRef block_map = getBlockMap(inode);
+    bool ok = block_map && old_blocks + count <= block_map->size();
+    if (ok) {
+        std::vector<uint32_t> blocks(block_map->begin() + old_blocks,
+                                     block_map->begin() + old_blocks + count);
+        std::vector<const char*> buffers(count);
+        for (uint32_t i = 0; i < count; i++) {
+            buffers[i] = tail->data.data() + static_cast<size_t>(i) * BLOCK_SIZE;
+        }
+        ok = cache->writeBlocks(blocks.data(), buffers.data(), count);
+    }
+    
+    // 新 Inode 与删除尾部缓冲在同一把锁下完成，读者看到的总是其中一种完整状态
+    std::lock_guard<std::mutex> guard(delayed_mutex);
+    if (publish && !writeInode(inode.inode_id, inode)) {
+        ok = false;
+    }
+    delayed.erase(inode.inode_id);
+    return ok;
+}
+
+void FileSystem::dropDelayed(uint32_t inode_id) {
+    if (delayed_blocks == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(delayed_mutex);
+    auto it = delayed.find(inode_id);
+    if (it != delayed.end()) {
+        delayed_blocks -= static_cast<uint32_t>(it->second->data.size() / BLOCK_SIZE);
+        delayed.erase(it);
+    }
+}
+
+bool FileSystem::flushDelayed() {
+    // 提交时 lockUpdates 已等待所有修改操作结束，尾部缓冲不会再被写入
+    std::vector<uint32_t> inode_ids;
+    {
+        std::lock_guard<std::mutex> guard(delayed_mutex);
+        for (const auto& entry : delayed) {
+            inode_ids.push_back(entry.first);
+        }
+    }
+    bool ok = true;
+    for (uint32_t inode_id : inode_ids) {
+        Inode inode;
+        if (!readInode(inode_id, inode) || !allocateDelayed(inode, true)) {
+            std::cerr << "错误：为文件 Inode " << inode_id << " 分配延迟写入的块失败" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool FileSystem::readInodeRange(const Inode& inode, uint32_t offset, char* buffer,
+                                uint32_t length) {
+    if (offset >= inode.file_size || length == 0) {
+        return true;
+    }
+    length = std::min(length, inode.file_size - offset);
+    uint32_t end = offset + length;
+    uint32_t first = offset / BLOCK_SIZE;
+    uint32_t last = (end - 1) / BLOCK_SIZE;
+    
+    // 超出已分配块的部分在尾部缓冲中；没有缓冲说明提交时刚为它分配了块，
+    // 改用 Inode 缓存中的最新映射
+    Inode current = inode;
+    std::shared_ptr<const DelayedTail> tail;
+    if (inode.file_type == FILE_TYPE_REGULAR && last >= inode.blocks_count) {
+        std::lock_guard<std::mutex> guard(delayed_mutex);
+        auto it = delayed.find(inode.inode_id);
+        if (it != delayed.end()) {
+            tail = it->second;
+        } else if (!readInode(inode.inode_id, current)) {
+            return false;
+        }
+    }
+    uint32_t mapped = tail ? current.blocks_count : last + 1;  // 前 mapped 个逻辑块已分配
+    if (tail && last >= mapped && last - mapped >= tail->data.size() / BLOCK_SIZE) {
+        return false;
+    }
+    
+    BlockMapRef block_map = getBlockMap(current);
+    if (!block_map || std::min(last + 1, mapped) > block_map->size()) {
+        return false;
+    }
+    
+    // 整块直接读入调用者缓冲区，作为一批请求提交（同一 extent 内合并为一次连续读）；
+    // 首尾不完整的块在缓存帧上拷贝所需部分，尾部缓冲中的块直接拷贝
+    std::vector<uint32_t> blocks;
+    std::vector<char*> buffers;
+    for (uint32_t i = first; i <= last; i++) {
+        uint32_t block_start = i * BLOCK_SIZE;
+        uint32_t lo = std::max(offset, block_start) - block_start;
+        uint32_t hi = std::min(end, block_start + BLOCK_SIZE) - block_start;
+        char* dest = buffer + (block_start + lo - offset);
+        if (i >= mapped) {
+            memcpy(dest, tail->data.data() + static_cast<size_t>(i - mapped) * BLOCK_SIZE + lo, hi - lo);
+            continue;
+        }
+        if (lo == 0 && hi == BLOCK_SIZE) {
+            blocks.push_back((*block_map)[i]);
+            buffers.push_back(dest);
+            continue;
+        }
+        
+        uint32_t block_num = (*block_map)[i];
+        const char* block = cache->pinBlock(block_num);
+        if (!block) {
+            return false;
+        }
+        memcpy(dest, block + lo, hi - lo);
+        cache->unpinBlock(block_num, false);
+    }
+    
+    return cache->readBlocks(blocks.data(), buffers.data(), blocks.size());
+}
+
+bool FileSystem::writeInodeRange(Inode& inode, uint32_t offset, const char* buffer,
+                                 uint32_t length) {
+    if (length == 0) {
+        return true;
+    }
+    if (static_cast<uint64_t>(offset) + length > MAX_FILE_SIZE) {
+        std::cerr << "错误：文件大小超过限制" << std::endl;
+        return false;
+    }
+    uint32_t end = offset + length;
+    
+    // 普通文件写到已分配的块之后：已分配部分原地写，其余放入尾部缓冲，提交时再分配。
+    // sync 模式每次操作都要落盘，不做延迟分配
+    if (inode.file_type == FILE_TYPE_REGULAR && end > inode.blocks_count * BLOCK_SIZE) {
+        uint32_t allocated = inode.blocks_count * BLOCK_SIZE;
+        if (durability != DURABILITY_SYNC) {
+            uint32_t head = offset < allocated ? allocated - offset : 0;
+            if (head > 0 && !writeInodeRange(inode, offset, buffer, head)) {
+                return false;
+            }
+            if (bufferTail(inode, std::max(inode.file_size, end), offset + head, buffer + head,
+                           length - head)) {
+                inode.modify_time = time(nullptr);
+                return true;
+            }
+            offset += head;
+            buffer += head;
+            length -= head;
+        }
+        // 缓冲放不下：先为已有的尾部缓冲分配块，再按下面的方式立即分配
+        if (!allocateDelayed(inode, false)) {
+            return false;
+        }
+    }
+    uint32_t first = offset / BLOCK_SIZE;
+    uint32_t last = (end - 1) / BLOCK_SIZE;
+    
+    // 写入范围超出已分配的块时先扩展文件
+    uint32_t old_blocks = inode.blocks_count;
+    if (last + 1 > old_blocks && !growInode(inode, last + 1 - old_blocks)) {
+        return false;
+    }
+    BlockMapRef block_map = getBlockMap(inode);
+    if (!block_map || last >= block_map->size()) {
+        return false;
+    }
+    
+    // 目录内容是元数据：涉及的块先加入日志事务
+    if (inode.file_type == FILE_TYPE_DIRECTORY) {
+        for (uint32_t i = std::min(old_blocks, first); i <= last; i++) {
+            journal->addBlock((*block_map)[i], i < old_blocks);
+        }
+    }
+    
+    // 原文件末尾与写入起点之间新分配的块清零
+    for (uint32_t i = old_blocks; i < first; i++) {
+        char* block = cache->pinBlock((*block_map)[i], false);
+        if (!block) {
+            return false;
+        }
+        memset(block, 0, BLOCK_SIZE);
+        cache->unpinBlock((*block_map)[i], true);
+    }
+    
+    // 整块直接批量写入；首尾不完整的块只在缓存帧上读-改-写，
+    // 新分配的块无需从磁盘读取，先清零再拷贝
+    std::vector<uint32_t> blocks;
+    std::vector<const char*> buffers;
+    for (uint32_t i = first; i <= last; i++) {
+        uint32_t block_start = i * BLOCK_SIZE;
+        uint32_t lo = std::max(offset, block_start) - block_start;
+        uint32_t hi = std::min(end, block_start + BLOCK_SIZE) - block_start;
+        const char* src = buffer + (block_start + lo - offset);
+        if (lo == 0 && hi == BLOCK_SIZE) {
+            blocks.push_back((*block_map)[i]);
+            buffers.push_back(src);
+            continue;
+        }
+        
+        uint32_t block_num = (*block_map)[i];
+        bool existing = i < old_blocks;
+        char* block = cache->pinBlock(block_num, existing);
+        if (!block) {
+            return false;
+        }
+        if (!existing) {
+            memset(block, 0, BLOCK_SIZE);
+        }
+        memcpy(block + lo, src, hi - lo);
+        cache->unpinBlock(block_num, true);
+    }
+    
+    if (!cache->writeBlocks(blocks.data(), buffers.data(), blocks.size())) {
+        return false;
+    }
+    
+    if (end > inode.file_size) {
+        inode.file_size = end;
+    }
+    inode.modify_time = time(nullptr);
+    return true;
+}
+
+bool FileSystem::truncateInode(Inode& inode, uint32_t size) {
+    if (size > MAX_FILE_SIZE) {
+        std::cerr << "错误：文件大小超过限制" << std::endl;
+        return false;
+    }
+    
+    // 普通文件：大小仍超出已分配的块时只调整尾部缓冲；
+    // 截断到已分配部分以内时尾部缓冲整个丢弃，从未分配过块
+    if (inode.file_type == FILE_TYPE_REGULAR) {
+        if (size > inode.blocks_count * BLOCK_SIZE) {
+            if (durability != DURABILITY_SYNC && bufferTail(inode, size, size, nullptr, 0)) {
+                inode.modify_time = time(nullptr);
+                return true;
+            }
+            if (!allocateDelayed(inode, false)) {
+                return false;
+            }
+        } else {
+            dropDelayed(inode.inode_id);
+        }
+    }
+    uint32_t keep_blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    
+    if (keep_blocks < inode.blocks_count) {
+        // 缩小：截断 extent 并释放多余的块
+        std::vector<Extent> extents;
+        std::vector<Extent> removed;
+        if (!loadExtents(inode, extents)) {
+            return false;
+        }
+        splitExtents(extents, keep_blocks, removed);
+        if (!storeExtents(inode, extents)) {
+            return false;
+        }
+        for (const auto& extent : removed) {
+            freeExtent(extent);
+        }
+    } else if (keep_blocks > inode.blocks_count) {
+        // 扩大：新块清零
+        uint32_t old_blocks = inode.blocks_count;
+        if (!growInode(inode, keep_blocks - old_blocks)) {
+            return false;
+        }
+        for (uint32_t i = old_blocks; i < keep_blocks; i++) {
+            uint32_t block_num = lookupBlock(inode, i);
+            if (block_num != UINT32_MAX && inode.file_type == FILE_TYPE_DIRECTORY) {
+                journal->addBlock(block_num, false);
+            }
+            char* block = block_num == UINT32_MAX ? nullptr : cache->pinBlock(block_num, false);
+            if (!block) {
+                return false;
+            }
+            memset(block, 0, BLOCK_SIZE);
+            cache->unpinBlock(block_num, true);
+        }
+    }
+    
+    // 保持"文件末尾之后的块内字节为 0"，之后扩展文件时无需再清零
+    if (size < inode.file_size && size % BLOCK_SIZE != 0) {
+        uint32_t block_num = lookupBlock(inode, size / BLOCK_SIZE);
+        if (block_num != UINT32_MAX && inode.file_type == FILE_TYPE_DIRECTORY) {
+            journal->addBlock(block_num);
+        }
+        char* block = block_num == UINT32_MAX ? nullptr : cache->pinBlock(block_num);
+        if (!block) {
+            return false;
+        }
+        memset(block + size % BLOCK_SIZE, 0, BLOCK_SIZE - size % BLOCK_SIZE);
+        cache->unpinBlock(block_num, true);
+    }
+    
+    inode.file_size = size;
+    inode.modify_time = time(nullptr);
+    return true;
+}
+
+bool FileSystem::readInodeData(const Inode& inode, char* buffer, uint32_t size) {
+    return readInodeRange(inode, 0, buffer, size);
+}
+
+bool FileSystem::writeInodeData(Inode& inode, const char* buffer, uint32_t size) {
+    // 原地覆盖：保留已有的块，只在长度变化时截断或扩展
+    if (size > MAX_FILE_SIZE) {
+        std::cerr << "错误：文件大小超过限制" << std::endl;
+        return false;
+    }
+    if (size < inode.file_size && !truncateInode(inode, size)) {
+        return false;
+    }
+    if (!writeInodeRange(inode, 0, buffer, size)) {
+        return false;
+    }
+    inode.modify_time = time(nullptr);
+    return true;
+}
+
+// ============= 目录操作 =============
+
+// FNV-1a 名字哈希，只取目录项中实际能保存的部分
+static uint32_t hashFileName(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < MAX_FILENAME - 1 && name[i] != '\0'; i++) {
+        hash ^= static_cast<uint8_t>(name[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// 返回索引块中负责 hash 的索引项下标（最后一个下界不大于 hash 的项）
+static uint32_t searchDirectoryIndex(const DirIndexBlock& index, uint32_t hash) {
+    const DirIndexEntry* begin = index.entries;
+    const DirIndexEntry* end = index.entries + index.header.count;
+    const DirIndexEntry* it = std::upper_bound(begin, end, hash,
+        [](uint32_t value, const DirIndexEntry& entry) { return value < entry.hash; });
+    return it == begin ? 0 : static_cast<uint32_t>(it - begin - 1);
+}
+
+// 按哈希有序插入索引项（调用者保证未满）
+static void insertIndexEntry(DirIndexBlock& index, uint32_t hash, uint32_t block) {
+    uint32_t pos = index.header.count == 0 ? 0 : searchDirectoryIndex(index, hash) + 1;
+    memmove(&index.entries[pos + 1], &index.entries[pos],
+            (index.header.count - pos) * sizeof(DirIndexEntry));
+    index.entries[pos].hash = hash;
+    index.entries[pos].block = block;
+    index.header.count++;
+}
+
+std::vector<DirectoryEntry> FileSystem::readDirectory(uint32_t dir_inode_id) {
+    std::vector<DirectoryEntry> entries;
+    
+    Inode dir_inode;
+    if (!readInode(dir_inode_id, dir_inode)) {
+        return entries;
+    }
+    
+    entries.reserve(dir_inode.entry_count);
+    if (!scanDirectory(dir_inode, [&entries](const DirectoryEntry& entry) {
+            entries.push_back(entry);
+            return true;
+        })) {
+        entries.clear();
+    }
+    return entries;
+}
+
+bool FileSystem::scanDirectory(const Inode& dir_inode,
+                               const std::function<bool(const DirectoryEntry&)>& visit) {
+    if (dir_inode.file_type != FILE_TYPE_DIRECTORY) {
+        return false;
+    }
+    
+    if (dir_inode.file_size == 0) {
+        return true;
+    }
+    
+    bool hashed = (dir_inode.flags & INODE_FLAG_HASHED_DIR) != 0;
+    uint32_t slot_count = dir_inode.file_size / sizeof(DirectoryEntry);
+    
+    // 先把目录的所有数据块一次性预读进缓存，再逐块解析
+    BlockMapRef block_map = getBlockMap(dir_inode);
+    if (!block_map) {
+        return false;
+    }
+    std::vector<uint32_t> blocks(*block_map);
+    cache->prefetchBlocks(blocks.data(), blocks.size());
+    
+    // 直接在缓存帧（或 mmap 映射区）上解析目录项，不经过中间缓冲区；
+    // 线性格式跳过空槽位，哈希格式跳过根块和索引节点块，只访问叶子块中的目录项
+    bool stopped = false;
+    for (uint32_t i = hashed ? 1 : 0; i < blocks.size() && !stopped; i++) {
+        uint32_t block_num = blocks[i];
+        
+        const char* block = cache->pinBlock(block_num);
+        if (!block) {
+            return false;
+        }
+        
+        if (hashed) {
+            const DirLeafBlock* leaf = reinterpret_cast<const DirLeafBlock*>(block);
+            if (leaf->header.magic == DIR_LEAF_MAGIC) {
+                uint32_t count = std::min(leaf->header.count, DIR_LEAF_CAPACITY);
+                for (uint32_t j = 0; j < count && !stopped; j++) {
+                    stopped = !visit(leaf->entries[j]);
+                }
+            }
+        } else {
+            const DirectoryEntry* dir_entries = reinterpret_cast<const DirectoryEntry*>(block);
+            uint32_t count = std::min(DIR_LINEAR_MAX, slot_count - i * DIR_LINEAR_MAX);
+            for (uint32_t j = 0; j < count && !stopped; j++) {
+                if (dir_entries[j].filename[0] != '\0') {
+                    stopped = !visit(dir_entries[j]);
+                }
+            }
+        }
+        cache->unpinBlock(block_num, false);
+    }
+    
     return true;
 }
 
-bool FileSystem::saveSuperBlock() {
-    char buffer[BLOCK_SIZE];
-    memset(buffer, 0, BLOCK_SIZE);
-    memcpy(buffer, &super_block, sizeof(SuperBlock));
-    return disk->writeBlock(0, buffer);
+uint32_t FileSystem::lookupDirectoryEntry(uint32_t dir_inode_id, const std::string& name) {
+    uint32_t inode_id;
+    if (dentry_cache->lookup(dir_inode_id, name, inode_id)) {
+        return inode_id;
+    }
+    // 未命中时读目录块，结果（包括不存在）记入缓存
+    inode_id = scanDirectoryEntry(dir_inode_id, name);
+    dentry_cache->insert(dir_inode_id, name, inode_id);
+    return inode_id;
 }
 
-bool FileSystem::loadBitmaps() {
-    char buffer[BLOCK_SIZE];
-    
-    // 读取 Inode 位图
-    if (!disk->readBlock(super_block.inode_bitmap_block, buffer)) {
-        return false;
+uint32_t FileSystem::scanDirectoryEntry(uint32_t dir_inode_id, const std::string& name) {
+    Inode dir_inode;
+    if (!readInode(dir_inode_id, dir_inode) || dir_inode.file_type != FILE_TYPE_DIRECTORY) {
+        return UINT32_MAX;
     }
-    for (uint32_t i = 0; i < MAX_INODES; i++) {
-        inode_bitmap[i] = (buffer[i / 8] & (1 << (i % 8))) != 0;
+    if (name.empty() || name.size() >= MAX_FILENAME) {
+        return UINT32_MAX;
     }
     
-    // 读取数据块位图
-    if (!disk->readBlock(super_block.data_bitmap_block, buffer)) {
-        return false;
-    }
-    for (uint32_t i = 0; i < MAX_BLOCKS; i++) {
-        data_bitmap[i] = (buffer[i / 8] & (1 << (i % 8))) != 0;
+    if (dir_inode.flags & INODE_FLAG_HASHED_DIR) {
+        // 哈希格式：根块 ->（索引节点块）-> 叶子块
+        uint32_t parent;
+        uint32_t leaf_block = findDirectoryLeaf(dir_inode, hashFileName(name.c_str()), parent);
+        DirLeafBlock leaf;
+        if (leaf_block == UINT32_MAX || !readDirectoryBlock(dir_inode, leaf_block, &leaf) ||
+            leaf.header.magic != DIR_LEAF_MAGIC) {
+            return UINT32_MAX;
+        }
+        for (uint32_t i = 0; i < leaf.header.count && i < DIR_LEAF_CAPACITY; i++) {
+            if (name == leaf.entries[i].filename) {
+                return leaf.entries[i].inode_id;
+            }
+        }
+        return UINT32_MAX;
     }
     
-    return true;
+    DirectoryEntry entry;
+    if (scanLinearDirectory(dir_inode, 0, name, &entry) == dir_inode.file_size / sizeof(DirectoryEntry)) {
+        return UINT32_MAX;
+    }
+    return entry.inode_id;
 }
 
-bool FileSystem::saveBitmaps() {
-    char buffer[BLOCK_SIZE];
-    
-    // 保存 Inode 位图
-    memset(buffer, 0, BLOCK_SIZE);
-    for (uint32_t i = 0; i < MAX_INODES; i++) {
-        if (inode_bitmap[i]) {
-            buffer[i / 8] |= (1 << (i % 8));
+uint32_t FileSystem::scanLinearDirectory(const Inode& dir_inode, uint32_t start, const std::string& name,
+                                         DirectoryEntry* found) {
+    // 在缓存帧上逐项比较；空槽位的文件名为空，只在查找空槽位时匹配
+    uint32_t slot_count = dir_inode.file_size / sizeof(DirectoryEntry);
+    uint32_t slot = start;
+    while (slot < slot_count) {
+        uint32_t i = slot / DIR_LINEAR_MAX;
+        uint32_t block_num = lookupBlock(dir_inode, i);
+        const char* block = block_num == UINT32_MAX ? nullptr : cache->pinBlock(block_num);
+        if (!block) {
+            return slot_count;
+        }
+        const DirectoryEntry* dir_entries = reinterpret_cast<const DirectoryEntry*>(block);
+        uint32_t end = std::min(slot_count, (i + 1) * DIR_LINEAR_MAX);
+        while (slot < end && name != dir_entries[slot % DIR_LINEAR_MAX].filename) {
+            slot++;
+        }
+        if (slot < end && found) {
+            *found = dir_entries[slot % DIR_LINEAR_MAX];
+        }
+        cache->unpinBlock(block_num, false);
+        if (slot < end) {
+            return slot;
         }
     }
-    if (!disk->writeBlock(super_block.inode_bitmap_block, buffer)) {
-        return false;
+    return slot_count;
+}
+
+bool FileSystem::trimDirectoryTail(Inode& dir_inode) {
+    // 惰性压缩：只回收末尾连续的空槽位，中间的空槽位留给之后的插入复用
+    uint32_t slot_count = dir_inode.file_size / sizeof(DirectoryEntry);
+    uint32_t new_count = slot_count;
+    while (new_count > 0) {
+        uint32_t i = (new_count - 1) / DIR_LINEAR_MAX;
+        uint32_t block_num = lookupBlock(dir_inode, i);
+        const char* block = block_num == UINT32_MAX ? nullptr : cache->pinBlock(block_num);
+        if (!block) {
+            return false;
+        }
+        const DirectoryEntry* dir_entries = reinterpret_cast<const DirectoryEntry*>(block);
+        while (new_count > i * DIR_LINEAR_MAX &&
+               dir_entries[(new_count - 1) % DIR_LINEAR_MAX].filename[0] == '\0') {
+            new_count--;
+        }
+        cache->unpinBlock(block_num, false);
+        if (new_count > i * DIR_LINEAR_MAX) {
+            break;
+        }
     }
     
-    // 保存数据块位图
-    memset(buffer, 0, BLOCK_SIZE);
-    for (uint32_t i = 0; i < MAX_BLOCKS; i++) {
-        if (data_bitmap[i]) {
-            buffer[i / 8] |= (1 << (i % 8));
-        }
+    if (new_count == slot_count) {
+        return true;
     }
-    if (!disk->writeBlock(super_block.data_bitmap_block, buffer)) {
+    dir_inode.free_slot = std::min(dir_inode.free_slot, new_count);
+    return truncateInode(dir_inode, new_count * sizeof(DirectoryEntry));
+}
+
+bool FileSystem::readDirectoryBlock(const Inode& dir_inode, uint32_t logical_block, void* buffer) {
+    uint32_t block_num = lookupBlock(dir_inode, logical_block);
+    const char* block = block_num == UINT32_MAX ? nullptr : cache->pinBlock(block_num);
+    if (!block) {
+        std::cerr << "错误：无法读取目录块" << std::endl;
         return false;
     }
-    
+    memcpy(buffer, block, BLOCK_SIZE);
+    cache->unpinBlock(block_num, false);
     return true;
 }
 
-uint32_t FileSystem::allocateInode() {
-    for (uint32_t i = 0; i < MAX_INODES; i++) {
-        if (!inode_bitmap[i]) {
-            inode_bitmap[i] = true;
-            super_block.free_inodes--;
-            saveBitmaps();
-            saveSuperBlock();
-            return i;
-        }
+bool FileSystem::writeDirectoryBlock(const Inode& dir_inode, uint32_t logical_block,
+                                     const void* buffer) {
+    uint32_t block_num = lookupBlock(dir_inode, logical_block);
+    if (block_num != UINT32_MAX) {
+        journal->addBlock(block_num, false);
     }
-    return UINT32_MAX; // 没有空闲 Inode
+    char* block = block_num == UINT32_MAX ? nullptr : cache->pinBlock(block_num, false);
+    if (!block) {
+        std::cerr << "错误：无法写入目录块" << std::endl;
+        return false;
+    }
+    memcpy(block, buffer, BLOCK_SIZE);
+    cache->unpinBlock(block_num, true);
+    return true;
 }
 
-void FileSystem::freeInode(uint32_t inode_id) {
-    if (inode_id < MAX_INODES && inode_bitmap[inode_id]) {
-        inode_bitmap[inode_id] = false;
-        super_block.free_inodes++;
-        saveBitmaps();
-        saveSuperBlock();
+uint32_t FileSystem::appendDirectoryBlock(Inode& dir_inode) {
+    if (static_cast<uint64_t>(dir_inode.file_size) + BLOCK_SIZE > MAX_FILE_SIZE) {
+        std::cerr << "错误：目录过大" << std::endl;
+        return UINT32_MAX;
+    }
+    if (!growInode(dir_inode, 1)) {
+        return UINT32_MAX;
     }
+    dir_inode.file_size = dir_inode.blocks_count * BLOCK_SIZE;
+    return dir_inode.blocks_count - 1;
 }
 
-uint32_t FileSystem::allocateDataBlock() {
-    for (uint32_t i = super_block.data_block_start; i < MAX_BLOCKS; i++) {
-        if (!data_bitmap[i]) {
-            data_bitmap[i] = true;
-            super_block.free_blocks--;
-            saveBitmaps();
-            saveSuperBlock();
-            return i;
+uint32_t FileSystem::findDirectoryLeaf(const Inode& dir_inode, uint32_t hash, uint32_t& parent) {
+    DirIndexBlock index;
+    parent = 0;
+    if (!readDirectoryBlock(dir_inode, 0, &index) || index.header.magic != DIR_ROOT_MAGIC) {
+        std::cerr << "错误：目录索引已损坏" << std::endl;
+        return UINT32_MAX;
+    }
+    
+    uint32_t levels = index.header.levels;
+    for (uint32_t level = 0; ; level++) {
+        if (index.header.count == 0 || index.header.count > DIR_INDEX_CAPACITY) {
+            std::cerr << "错误：目录索引已损坏" << std::endl;
+            return UINT32_MAX;
+        }
+        uint32_t child = index.entries[searchDirectoryIndex(index, hash)].block;
+        if (level == levels) {
+            return child;
+        }
+        parent = child;
+        if (!readDirectoryBlock(dir_inode, child, &index) || index.header.magic != DIR_NODE_MAGIC) {
+            std::cerr << "错误：目录索引已损坏" << std::endl;
+            return UINT32_MAX;
         }
     }
-    return UINT32_MAX; // 没有空闲数据块
 }
 
-void FileSystem::freeDataBlock(uint32_t block_id) {
-    if (block_id < MAX_BLOCKS && data_bitmap[block_id]) {
-        data_bitmap[block_id] = false;
-        super_block.free_blocks++;
-        saveBitmaps();
-        saveSuperBlock();
+bool FileSystem::convertToHashedDirectory(Inode& dir_inode) {
+    std::vector<DirectoryEntry> entries = readDirectory(dir_inode.inode_id);
+    std::vector<std::pair<uint32_t, uint32_t>> order;  // (哈希, 下标)
+    order.reserve(entries.size());
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        order.push_back({hashFileName(entries[i].filename), i});
+    }
+    std::sort(order.begin(), order.end());
+    
+    // 按哈希顺序把目录项装入叶子，每个叶子先装一半，为之后的插入留出空间；
+    // 相同哈希的目录项不跨叶子
+    std::vector<uint32_t> starts;
+    uint32_t total = static_cast<uint32_t>(order.size());
+    for (uint32_t i = 0; i < total || starts.empty(); ) {
+        starts.push_back(i);
+        uint32_t end = std::min(total, i + DIR_LEAF_CAPACITY / 2);
+        while (end < total && order[end].first == order[end - 1].first) {
+            end++;
+        }
+        if (end - i > DIR_LEAF_CAPACITY) {
+            std::cerr << "错误：目录中哈希相同的文件名过多" << std::endl;
+            return false;
+        }
+        i = end;
     }
-}
-
-bool FileSystem::readInode(uint32_t inode_id, Inode& inode) {
-    if (inode_id >= MAX_INODES) {
+    uint32_t leaf_count = static_cast<uint32_t>(starts.size());
+    if (leaf_count > DIR_INDEX_CAPACITY) {
+        std::cerr << "错误：目录过大" << std::endl;
         return false;
     }
     
-    uint32_t block_num = super_block.inode_table_block + (inode_id * INODE_SIZE) / BLOCK_SIZE;
-    uint32_t offset = (inode_id * INODE_SIZE) % BLOCK_SIZE;
+    // 原有的块原地复用为根块和叶子块，数量不足时扩展（新块清零），多余时释放
+    if (!truncateInode(dir_inode, (leaf_count + 1) * BLOCK_SIZE)) {
+        return false;
+    }
     
-    char buffer[BLOCK_SIZE];
-    if (!disk->readBlock(block_num, buffer)) {
+    DirIndexBlock root;
+    memset(&root, 0, sizeof(root));
+    root.header.magic = DIR_ROOT_MAGIC;
+    for (uint32_t l = 0; l < leaf_count; l++) {
+        DirLeafBlock leaf;
+        memset(&leaf.header, 0, sizeof(leaf.header));
+        leaf.header.magic = DIR_LEAF_MAGIC;
+        uint32_t end = l + 1 < leaf_count ? starts[l + 1] : total;
+        for (uint32_t i = starts[l]; i < end; i++) {
+            leaf.entries[leaf.header.count++] = entries[order[i].second];
+        }
+        if (!writeDirectoryBlock(dir_inode, l + 1, &leaf)) {
+            return false;
+        }
+        // 第一个叶子负责从 0 开始的全部哈希值
+        root.entries[l].hash = l == 0 ? 0 : order[starts[l]].first;
+        root.entries[l].block = l + 1;
+        root.header.count++;
+    }
+    if (!writeDirectoryBlock(dir_inode, 0, &root)) {
         return false;
     }
     
-    memcpy(&inode, buffer + offset, sizeof(Inode));
+    dir_inode.flags |= INODE_FLAG_HASHED_DIR;
     return true;
 }
 
-bool FileSystem::writeInode(uint32_t inode_id, const Inode& inode) {
-    if (inode_id >= MAX_INODES) {
+bool FileSystem::insertDirectoryIndex(Inode& dir_inode, uint32_t parent, uint32_t hash,
+                                      uint32_t child) {
+    DirIndexBlock index;
+    if (!readDirectoryBlock(dir_inode, parent, &index)) {
         return false;
     }
+    if (index.header.count < DIR_INDEX_CAPACITY) {
+        insertIndexEntry(index, hash, child);
+        return writeDirectoryBlock(dir_inode, parent, &index);
+    }
     
-    uint32_t block_num = super_block.inode_table_block + (inode_id * INODE_SIZE) / BLOCK_SIZE;
-    uint32_t offset = (inode_id * INODE_SIZE) % BLOCK_SIZE;
+    if (parent == 0) {
+        if (index.header.levels > 0) {
+            std::cerr << "错误：目录索引已满" << std::endl;
+            return false;
+        }
+        // 根块已满：全部索引项下移到新的索引节点块，根块增加一层
+        uint32_t node = appendDirectoryBlock(dir_inode);
+        if (node == UINT32_MAX) {
+            return false;
+        }
+        DirIndexBlock node_index = index;
+        node_index.header.magic = DIR_NODE_MAGIC;
+        node_index.header.levels = 0;
+        if (!writeDirectoryBlock(dir_inode, node, &node_index)) {
+            return false;
+        }
+        index.header.levels = 1;
+        index.header.count = 1;
+        index.entries[0].hash = 0;
+        index.entries[0].block = node;
+        if (!writeDirectoryBlock(dir_inode, 0, &index)) {
+            return false;
+        }
+        return insertDirectoryIndex(dir_inode, node, hash, child);
+    }
     
-    char buffer[BLOCK_SIZE];
-    if (!disk->readBlock(block_num, buffer)) {
+    // 索引节点块已满：对半分裂，后一半移入新节点并登记到根块
+    DirIndexBlock root;
+    if (!readDirectoryBlock(dir_inode, 0, &root)) {
+        return false;
+    }
+    if (root.header.count >= DIR_INDEX_CAPACITY) {
+        std::cerr << "错误：目录索引已满" << std::endl;
+        return false;
+    }
+    uint32_t sibling = appendDirectoryBlock(dir_inode);
+    if (sibling == UINT32_MAX) {
         return false;
     }
     
-    memcpy(buffer + offset, &inode, sizeof(Inode));
-    return disk->writeBlock(block_num, buffer);
+    uint32_t half = index.header.count / 2;
+    DirIndexBlock upper;
+    memset(&upper, 0, sizeof(upper));
+    upper.header.magic = DIR_NODE_MAGIC;
+    upper.header.count = index.header.count - half;
+    memcpy(upper.entries, &index.entries[half], upper.header.count * sizeof(DirIndexEntry));
+    index.header.count = half;
+    insertIndexEntry(hash >= upper.entries[0].hash ? upper : index, hash, child);
+    
+    insertIndexEntry(root, upper.entries[0].hash, sibling);
+    return writeDirectoryBlock(dir_inode, sibling, &upper) &&
+           writeDirectoryBlock(dir_inode, parent, &index) &&
+           writeDirectoryBlock(dir_inode, 0, &root);
 }
 
-bool FileSystem::readInodeData(const Inode& inode, char* buffer, uint32_t size) {
-    if (size > inode.file_size) {
-        size = inode.file_size;
+bool FileSystem::splitDirectoryLeaf(Inode& dir_inode, uint32_t leaf_block, uint32_t parent) {
+    DirLeafBlock leaf;
+    if (!readDirectoryBlock(dir_inode, leaf_block, &leaf)) {
+        return false;
     }
+    uint32_t count = std::min(leaf.header.count, DIR_LEAF_CAPACITY);
+    std::vector<std::pair<uint32_t, uint32_t>> order;  // (哈希, 槽位)
+    for (uint32_t i = 0; i < count; i++) {
+        order.push_back({hashFileName(leaf.entries[i].filename), i});
+    }
+    std::sort(order.begin(), order.end());
     
-    uint32_t bytes_read = 0;
-    char block_buffer[BLOCK_SIZE];
-    
-    // 读取直接块
-    for (uint32_t i = 0; i < DIRECT_BLOCKS && bytes_read < size; i++) {
-        if (inode.direct_blocks[i] == 0) break;
-        
-        if (!disk->readBlock(inode.direct_blocks[i], block_buffer)) {
-            return false;
+    // 从中点开始寻找哈希变化的位置（先向后再向前），相同哈希的目录项留在同一叶子
+    uint32_t split = count / 2;
+    while (split < count && order[split].first == order[split - 1].first) {
+        split++;
+    }
+    if (split == count) {
+        split = count / 2;
+        while (split > 0 && order[split].first == order[split - 1].first) {
+            split--;
         }
-        
-        uint32_t to_read = std::min(BLOCK_SIZE, size - bytes_read);
-        memcpy(buffer + bytes_read, block_buffer, to_read);
-        bytes_read += to_read;
     }
-    
-    return true;
-}
-
-bool FileSystem::writeInodeData(Inode& inode, const char* buffer, uint32_t size) {
-    if (size > MAX_FILE_SIZE) {
-        std::cerr << "错误：文件大小超过限制" << std::endl;
+    if (split == 0) {
+        std::cerr << "错误：目录中哈希相同的文件名过多" << std::endl;
         return false;
     }
     
-    uint32_t blocks_needed = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
-    if (blocks_needed > DIRECT_BLOCKS) {
-        std::cerr << "错误：文件过大（当前仅支持直接块）" << std::endl;
+    // 新叶子先写成空块再登记到索引，任何一步失败都不会丢失或重复目录项
+    uint32_t new_block = appendDirectoryBlock(dir_inode);
+    if (new_block == UINT32_MAX) {
         return false;
     }
-    
-    // 释放旧的数据块
-    for (uint32_t i = 0; i < DIRECT_BLOCKS; i++) {
-        if (inode.direct_blocks[i] != 0) {
-            freeDataBlock(inode.direct_blocks[i]);
-            inode.direct_blocks[i] = 0;
-        }
+    DirLeafBlock lower;
+    DirLeafBlock upper;
+    memset(&lower.header, 0, sizeof(lower.header));
+    memset(&upper.header, 0, sizeof(upper.header));
+    lower.header.magic = DIR_LEAF_MAGIC;
+    upper.header.magic = DIR_LEAF_MAGIC;
+    if (!writeDirectoryBlock(dir_inode, new_block, &upper) ||
+        !insertDirectoryIndex(dir_inode, parent, order[split].first, new_block)) {
+        return false;
     }
     
-    // 分配新的数据块并写入数据
-    uint32_t bytes_written = 0;
-    char block_buffer[BLOCK_SIZE];
+    for (uint32_t i = 0; i < count; i++) {
+        DirLeafBlock& target = i < split ? lower : upper;
+        target.entries[target.header.count++] = leaf.entries[order[i].second];
+    }
+    return writeDirectoryBlock(dir_inode, new_block, &upper) &&
+           writeDirectoryBlock(dir_inode, leaf_block, &lower);
+}
+
+bool FileSystem::insertHashedEntry(Inode& dir_inode, const DirectoryEntry& entry) {
+    uint32_t hash = hashFileName(entry.filename);
     
-    for (uint32_t i = 0; i < blocks_needed; i++) {
-        uint32_t block_id = allocateDataBlock();
-        if (block_id == UINT32_MAX) {
-            std::cerr << "错误：磁盘空间不足" << std::endl;
+    // 叶子已满时先分裂再重新定位；分裂后两半都不满，因此最多分裂一次
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint32_t parent;
+        uint32_t leaf_block = findDirectoryLeaf(dir_inode, hash, parent);
+        DirLeafBlock leaf;
+        if (leaf_block == UINT32_MAX || !readDirectoryBlock(dir_inode, leaf_block, &leaf) ||
+            leaf.header.magic != DIR_LEAF_MAGIC) {
             return false;
         }
-        
-        inode.direct_blocks[i] = block_id;
-        
-        memset(block_buffer, 0, BLOCK_SIZE);
-        uint32_t to_write = std::min(BLOCK_SIZE, size - bytes_written);
-        memcpy(block_buffer, buffer + bytes_written, to_write);
-        
-        if (!disk->writeBlock(block_id, block_buffer)) {
+        if (leaf.header.count < DIR_LEAF_CAPACITY) {
+            leaf.entries[leaf.header.count++] = entry;
+            return writeDirectoryBlock(dir_inode, leaf_block, &leaf);
+        }
+        if (!splitDirectoryLeaf(dir_inode, leaf_block, parent)) {
             return false;
         }
-        
-        bytes_written += to_write;
     }
-    
-    inode.file_size = size;
-    inode.blocks_count = blocks_needed;
-    inode.modify_time = time(nullptr);
-    
-    return true;
+    return false;
 }
 
-std::vector<DirectoryEntry> FileSystem::readDirectory(uint32_t dir_inode_id) {
-    std::vector<DirectoryEntry> entries;
-    
-    Inode dir_inode;
-    if (!readInode(dir_inode_id, dir_inode)) {
-        return entries;
-    }
-    
-    if (dir_inode.file_type != FILE_TYPE_DIRECTORY) {
-        return entries;
-    }
-    
-    if (dir_inode.file_size == 0) {
-        return entries;
+bool FileSystem::removeHashedEntry(Inode& dir_inode, const std::string& name) {
+    uint32_t parent;
+    uint32_t leaf_block = findDirectoryLeaf(dir_inode, hashFileName(name.c_str()), parent);
+    DirLeafBlock leaf;
+    if (leaf_block == UINT32_MAX || !readDirectoryBlock(dir_inode, leaf_block, &leaf) ||
+        leaf.header.magic != DIR_LEAF_MAGIC) {
+        return false;
     }
     
-    char* buffer = new char[dir_inode.file_size];
-    if (!readInodeData(dir_inode, buffer, dir_inode.file_size)) {
-        delete[] buffer;
-        return entries;
+    uint32_t count = std::min(leaf.header.count, DIR_LEAF_CAPACITY);
+    uint32_t slot = 0;
+    while (slot < count && name != leaf.entries[slot].filename) {
+        slot++;
     }
-    
-    uint32_t entry_count = dir_inode.file_size / sizeof(DirectoryEntry);
-    DirectoryEntry* dir_entries = reinterpret_cast<DirectoryEntry*>(buffer);
-    
-    for (uint32_t i = 0; i < entry_count; i++) {
-        entries.push_back(dir_entries[i]);
+    if (slot == count) {
+        std::cerr << "错误：文件不存在" << std::endl;
+        return false;
     }
     
-    delete[] buffer;
-    return entries;
+    // 用最后一项填补空位，叶子内保持紧凑
+    leaf.entries[slot] = leaf.entries[count - 1];
+    leaf.entries[count - 1] = DirectoryEntry();
+    leaf.header.count = count - 1;
+    return writeDirectoryBlock(dir_inode, leaf_block, &leaf);
 }
 
-bool FileSystem::addDirectoryEntry(uint32_t dir_inode_id, const std::string& name, uint32_t inode_id) {
+bool FileSystem::addDirectoryEntry(uint32_t dir_inode_id, const std::string& name,
+                                   uint32_t inode_id) {
     Inode dir_inode;
     if (!readInode(dir_inode_id, dir_inode)) {
         return false;
@@ -449,31 +1955,56 @@ bool FileSystem::addDirectoryEntry(uint32_t dir_inode_id, const std::string& nam
         return false;
     }
     
+    if (name.empty() || name.size() >= MAX_FILENAME) {
+        std::cerr << "错误：文件名长度必须在 1 到 " << MAX_FILENAME - 1 << " 个字符之间" << std::endl;
+        return false;
+    }
+    
     // 检查是否已存在同名文件
-    std::vector<DirectoryEntry> entries = readDirectory(dir_inode_id);
-    for (const auto& entry : entries) {
-        if (std::string(entry.filename) == name) {
-            std::cerr << "错误：文件已存在" << std::endl;
-            return false;
-        }
+    if (lookupDirectoryEntry(dir_inode_id, name) != UINT32_MAX) {
+        std::cerr << "错误：文件已存在" << std::endl;
+        return false;
     }
     
-    // 添加新目录项
     DirectoryEntry new_entry(name.c_str(), inode_id);
-    entries.push_back(new_entry);
+    dentry_cache->remove(dir_inode_id, name);
     
-    // 写回目录数据
-    uint32_t new_size = entries.size() * sizeof(DirectoryEntry);
-    char* buffer = new char[new_size];
-    memcpy(buffer, entries.data(), new_size);
-    
-    bool result = writeInodeData(dir_inode, buffer, new_size);
-    delete[] buffer;
+    // 线性格式的槽位全部占满后转换为哈希格式
+    bool hashed = (dir_inode.flags & INODE_FLAG_HASHED_DIR) != 0;
+    if (!hashed && dir_inode.entry_count >= DIR_LINEAR_MAX) {
+        if (!convertToHashedDirectory(dir_inode)) {
+            writeInode(dir_inode_id, dir_inode);
+            return false;
+        }
+        hashed = true;
+    }
     
+    bool result;
+    if (hashed) {
+        result = insertHashedEntry(dir_inode, new_entry);
+    } else {
+        // 线性格式：优先复用空槽位，否则追加到末尾，都只改动一个块
+        uint32_t slot = dir_inode.entry_count < dir_inode.file_size / sizeof(DirectoryEntry)
+                      ? scanLinearDirectory(dir_inode, dir_inode.free_slot, "", nullptr)
+                      : dir_inode.file_size / sizeof(DirectoryEntry);
+        result = writeInodeRange(dir_inode, slot * sizeof(DirectoryEntry),
+                                 reinterpret_cast<const char*>(&new_entry), sizeof(new_entry));
+        if (result) {
+            dir_inode.free_slot = slot + 1;
+        }
+    }
     if (result) {
-        writeInode(dir_inode_id, dir_inode);
+        dir_inode.entry_count++;
     }
+    dir_inode.modify_time = time(nullptr);
     
+    // 分裂可能已经扩展了目录，无论成败都写回 Inode
+    if (!writeInode(dir_inode_id, dir_inode)) {
+        return false;
+    }
+    if (result) {
+        dentry_cache->insert(dir_inode_id, name, inode_id);
+    }
     return result;
 }
 
@@ -486,94 +2017,99 @@ bool FileSystem::removeDirectoryEntry(uint32_t dir_inode_id, const std::string&
     if (dir_inode.file_type != FILE_TYPE_DIRECTORY) {
         return false;
     }
-    
-    std::vector<DirectoryEntry> entries = readDirectory(dir_inode_id);
-    auto it = std::remove_if(entries.begin(), entries.end(),
-        [&name](const DirectoryEntry& entry) {
-            return std::string(entry.filename) == name;
-        });
-    
-    if (it == entries.end()) {
+    if (name.empty() || name.size() >= MAX_FILENAME) {
         std::cerr << "错误：文件不存在" << std::endl;
         return false;
     }
+    dentry_cache->remove(dir_inode_id, name);
     
-    entries.erase(it, entries.end());
-    
-    // 写回目录数据
-    if (entries.empty()) {
-        dir_inode.file_size = 0;
-        dir_inode.blocks_count = 0;
-        for (uint32_t i = 0; i < DIRECT_BLOCKS; i++) {
-            if (dir_inode.direct_blocks[i] != 0) {
-                freeDataBlock(dir_inode.direct_blocks[i]);
-                dir_inode.direct_blocks[i] = 0;
+    bool result;
+    if (dir_inode.flags & INODE_FLAG_HASHED_DIR) {
+        result = removeHashedEntry(dir_inode, name);
+    } else {
+        // 线性格式：把槽位置空，只改写所在的块；位于末尾时顺带回收末尾的空槽位
+        uint32_t slot_count = dir_inode.file_size / sizeof(DirectoryEntry);
+        uint32_t slot = scanLinearDirectory(dir_inode, 0, name, nullptr);
+        if (slot == slot_count) {
+            std::cerr << "错误：文件不存在" << std::endl;
+            return false;
+        }
+        DirectoryEntry empty;
+        result = writeInodeRange(dir_inode, slot * sizeof(DirectoryEntry),
+                                 reinterpret_cast<const char*>(&empty), sizeof(empty));
+        if (result) {
+            dir_inode.free_slot = std::min(dir_inode.free_slot, slot);
+            if (slot == slot_count - 1) {
+                result = trimDirectoryTail(dir_inode);
             }
         }
-        return writeInode(dir_inode_id, dir_inode);
     }
     
-    uint32_t new_size = entries.size() * sizeof(DirectoryEntry);
-    char* buffer = new char[new_size];
-    memcpy(buffer, entries.data(), new_size);
-    
-    bool result = writeInodeData(dir_inode, buffer, new_size);
-    delete[] buffer;
-    
-    if (result) {
-        writeInode(dir_inode_id, dir_inode);
+    if (result && --dir_inode.entry_count == 0) {
+        // 目录已清空：释放全部块（哈希格式退回线性格式）
+        freeInodeBlocks(dir_inode);
+        dir_inode.file_size = 0;
+        dir_inode.free_slot = 0;
+        dir_inode.flags &= ~INODE_FLAG_HASHED_DIR;
     }
+    dir_inode.modify_time = time(nullptr);
     
+    if (!writeInode(dir_inode_id, dir_inode)) {
+        return false;
+    }
     return result;
 }
 
-uint32_t FileSystem::findInodeByPath(const std::string& path) {
-    if (path.empty()) {
-        return current_dir_inode;
+// 从 pos 开始取出下一个非空路径分量，没有更多分量时返回 false
+static bool nextPathComponent(const std::string& path, size_t& pos, std::string& component) {
+    while (pos < path.size()) {
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        size_t start = pos;
+        pos = end + 1;
+        if (end > start) {
+            component.assign(path, start, end - start);
+            return true;
+        }
     }
+    return false;
+}
+
+uint32_t FileSystem::findInodeByPath(const Session& session, const std::string& path) {
+    uint32_t inode_id = session.cwd_inode;
     
-    uint32_t inode_id = current_dir_inode;
-    
-    if (path[0] == '/') {
+    if (!path.empty() && path[0] == '/') {
         inode_id = 0; // 从根目录开始
     }
     
-    if (path == "/" || path == ".") {
-        return inode_id;
-    }
-    
-    // 解析路径
-    std::string path_copy = path;
-    if (path_copy[0] == '/') {
-        path_copy = path_copy.substr(1);
-    }
-    
-    std::istringstream iss(path_copy);
+    // 逐级解析：每一级是一次目录项缓存查找，.. 经由目录 Inode 中的父目录编号
+    size_t pos = 0;
     std::string component;
-    
-    while (std::getline(iss, component, '/')) {
-        if (component.empty() || component == ".") {
+    while (nextPathComponent(path, pos, component)) {
+        if (component == ".") {
             continue;
         }
         
         if (component == "..") {
-            // 处理父目录（简化实现，未完全支持）
+            Inode dir_inode;
+            if (!readInode(inode_id, dir_inode) || dir_inode.file_type != FILE_TYPE_DIRECTORY) {
+                return UINT32_MAX;
+            }
+            inode_id = dir_inode.parent_id;
             continue;
         }
         
-        // 在当前目录查找
-        std::vector<DirectoryEntry> entries = readDirectory(inode_id);
-        bool found = false;
-        
-        for (const auto& entry : entries) {
-            if (std::string(entry.filename) == component) {
-                inode_id = entry.inode_id;
-                found = true;
-                break;
-            }
+        // 在当前目录查找：目录项缓存命中时无需加锁，未命中时持目录读锁扫描目录块
+        uint32_t child_id;
+        if (!dentry_cache->lookup(inode_id, component, child_id)) {
+            acquireReadLock(inode_id);
+            child_id = lookupDirectoryEntry(inode_id, component);
+            releaseReadLock(inode_id);
         }
-        
-        if (!found) {
+        inode_id = child_id;
+        if (inode_id == UINT32_MAX) {
             return UINT32_MAX; // 路径不存在
         }
     }
@@ -581,18 +2117,19 @@ uint32_t FileSystem::findInodeByPath(const std::string& path) {
     return inode_id;
 }
 
-bool FileSystem::checkPermission(const Inode& inode, uint16_t required_perm) {
-    if (!current_user) {
+bool FileSystem::checkPermission(const Session& session, const Inode& inode,
+                                 uint16_t required_perm) {
+    if (!session.logged_in) {
         return false;
     }
     
     // root 用户拥有所有权限
-    if (current_user->is_root) {
+    if (session.user.is_root) {
         return true;
     }
     
     // 检查所有者权限
-    if (inode.owner_id == current_user->uid) {
+    if (inode.owner_id == session.user.uid) {
         uint16_t owner_perm = (inode.permission >> 6) & 0x07;
         return (owner_perm & required_perm) == required_perm;
     }
@@ -603,76 +2140,37 @@ bool FileSystem::checkPermission(const Inode& inode, uint16_t required_perm) {
 }
 
 void FileSystem::acquireReadLock(uint32_t inode_id) {
-    std::unique_lock<std::mutex> lock(open_files_mutex);
-    
-    if (open_files.find(inode_id) == open_files.end()) {
-        open_files[inode_id] = std::make_shared<OpenFileEntry>();
-        open_files[inode_id]->inode_id = inode_id;
-    }
-    
-    auto& entry = open_files[inode_id];
-    std::unique_lock<std::mutex> file_lock(entry->mutex);
-    lock.unlock();
-    
-    // 等待直到没有写者
-    entry->cv.wait(file_lock, [&entry] { return !entry->is_writing; });
-    entry->reader_count++;
+    lock_table->lockShared(inode_id);
 }
 
 void FileSystem::releaseReadLock(uint32_t inode_id) {
-    std::unique_lock<std::mutex> lock(open_files_mutex);
-    
-    if (open_files.find(inode_id) == open_files.end()) {
-        return;
-    }
-    
-    auto entry = open_files[inode_id];
-    lock.unlock();  // 先释放 open_files_mutex
-    
-    std::lock_guard<std::mutex> file_lock(entry->mutex);
-    entry->reader_count--;
-    if (entry->reader_count == 0) {
-        entry->cv.notify_all(); // 唤醒等待的写者
-    }
+    lock_table->unlockShared(inode_id);
 }
 
 void FileSystem::acquireWriteLock(uint32_t inode_id) {
-    std::unique_lock<std::mutex> lock(open_files_mutex);
-    
-    if (open_files.find(inode_id) == open_files.end()) {
-        open_files[inode_id] = std::make_shared<OpenFileEntry>();
-        open_files[inode_id]->inode_id = inode_id;
-    }
-    
-    auto& entry = open_files[inode_id];
-    std::unique_lock<std::mutex> file_lock(entry->mutex);
-    lock.unlock();
-    
-    // 等待直到没有读者和写者
-    entry->cv.wait(file_lock, [&entry] { 
-        return entry->reader_count == 0 && !entry->is_writing; 
-    });
-    entry->is_writing = true;
+    lock_table->lockExclusive(inode_id);
 }
 
 void FileSystem::releaseWriteLock(uint32_t inode_id) {
-    std::unique_lock<std::mutex> lock(open_files_mutex);
-    
-    if (open_files.find(inode_id) == open_files.end()) {
-        return;
-    }
-    
-    auto entry = open_files[inode_id];
-    lock.unlock();  // 先释放 open_files_mutex
-    
-    std::lock_guard<std::mutex> file_lock(entry->mutex);
-    entry->is_writing = false;
-    entry->cv.notify_all(); // 唤醒所有等待者
+    lock_table->unlockExclusive(inode_id);
+}
+
+int FileSystem::lockInodeRange(uint32_t inode_id, bool exclusive) {
+    uint64_t offset = static_cast<uint64_t>(super_block.inode_table_block) * BLOCK_SIZE +
+                      static_cast<uint64_t>(inode_id) * INODE_SIZE;
+    return disk->lockRange(offset, INODE_SIZE, exclusive, lock_timeout_ms);
+}
+
+void FileSystem::unlockInodeRange(uint32_t inode_id, int handle) {
+    uint64_t offset = static_cast<uint64_t>(super_block.inode_table_block) * BLOCK_SIZE +
+                      static_cast<uint64_t>(inode_id) * INODE_SIZE;
+    disk->unlockRange(handle, offset, INODE_SIZE);
 }
 
 // ============= 用户管理 =============
 
 bool FileSystem::addUser(const std::string& username, const std::string& password, bool is_root) {
+    std::lock_guard<std::mutex> lock(users_mutex);
     // 检查用户名是否已存在
     for (const auto& pair : users) {
         if (pair.second.username == username) {
@@ -691,10 +2189,14 @@ bool FileSystem::addUser(const std::string& username, const std::string& passwor
     return true;
 }
 
-bool FileSystem::login(const std::string& username, const std::string& password) {
+bool FileSystem::login(Session& session, const std::string& username, const std::string& password) {
+    std::lock_guard<std::mutex> lock(users_mutex);
     for (auto& pair : users) {
         if (pair.second.username == username && pair.second.password == password) {
-            current_user = &pair.second;
+            // 会话保存用户信息的副本（不含密码），挂载时重建用户表也不受影响
+            session.logged_in = true;
+            session.user = pair.second;
+            session.user.password.clear();
             std::cout << "用户 " << username << " 登录成功！" << std::endl;
             return true;
         }
@@ -703,34 +2205,46 @@ bool FileSystem::login(const std::string& username, const std::string& password)
     return false;
 }
 
-void FileSystem::logout() {
-    if (current_user) {
-        std::cout << "用户 " << current_user->username << " 退出登录" << std::endl;
-        current_user = nullptr;
+void FileSystem::logout(Session& session) {
+    if (session.logged_in) {
+        std::cout << "用户 " << session.user.username << " 退出登录" << std::endl;
+        session.logged_in = false;
+        session.user = User();
     }
 }
 
 // ============= 文件操作 =============
 
-bool FileSystem::createFile(const std::string& filename) {
-    if (!current_user) {
+bool FileSystem::createFile(const Session& session, const std::string& filename) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
     
-    // 检查父目录写权限
+    // 持父目录写锁完成查重、分配和添加目录项
+    acquireWriteLock(session.cwd_inode);
+    journal->beginUpdate();
+    bool result = createFileLocked(session, filename);
+    journal->endUpdate();
+    releaseWriteLock(session.cwd_inode);
+    return result;
+}
+
+bool FileSystem::createFileLocked(const Session& session, const std::string& filename) {
+    // 检查父目录写权限（当前目录可能已被其他会话删除）
     Inode dir_inode;
-    if (!readInode(current_dir_inode, dir_inode)) {
+    if (!inodeInUse(session.cwd_inode) || !readInode(session.cwd_inode, dir_inode)) {
+        std::cerr << "错误：当前目录已不存在" << std::endl;
         return false;
     }
     
-    if (!checkPermission(dir_inode, PERM_WRITE)) {
+    if (!checkPermission(session, dir_inode, PERM_WRITE)) {
         std::cerr << "错误：没有写权限" << std::endl;
         return false;
     }
     
-    // 分配新 Inode
-    uint32_t new_inode_id = allocateInode();
+    // 分配新 Inode（与父目录放在同一分配组）
+    uint32_t new_inode_id = allocateInode(session.cwd_inode, false);
     if (new_inode_id == UINT32_MAX) {
         std::cerr << "错误：Inode 已用完" << std::endl;
         return false;
@@ -741,7 +2255,7 @@ bool FileSystem::createFile(const std::string& filename) {
     file_inode.inode_id = new_inode_id;
     file_inode.file_type = FILE_TYPE_REGULAR;
     file_inode.permission = DEFAULT_FILE_PERM;
-    file_inode.owner_id = current_user->uid;
+    file_inode.owner_id = session.user.uid;
     file_inode.file_size = 0;
     file_inode.blocks_count = 0;
     file_inode.create_time = time(nullptr);
@@ -749,12 +2263,18 @@ bool FileSystem::createFile(const std::string& filename) {
     
     if (!writeInode(new_inode_id, file_inode)) {
         freeInode(new_inode_id);
+        commit();
         return false;
     }
     
     // 添加到目录
-    if (!addDirectoryEntry(current_dir_inode, filename, new_inode_id)) {
+    if (!addDirectoryEntry(session.cwd_inode, filename, new_inode_id)) {
         freeInode(new_inode_id);
+        commit();
+        return false;
+    }
+    
+    if (!commit()) {
         return false;
     }
     
@@ -762,25 +2282,35 @@ bool FileSystem::createFile(const std::string& filename) {
     return true;
 }
 
-bool FileSystem::createDirectory(const std::string& dirname) {
-    if (!current_user) {
+bool FileSystem::createDirectory(const Session& session, const std::string& dirname) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
     
-    // 检查父目录写权限
+    acquireWriteLock(session.cwd_inode);
+    journal->beginUpdate();
+    bool result = createDirectoryLocked(session, dirname);
+    journal->endUpdate();
+    releaseWriteLock(session.cwd_inode);
+    return result;
+}
+
+bool FileSystem::createDirectoryLocked(const Session& session, const std::string& dirname) {
+    // 检查父目录写权限（当前目录可能已被其他会话删除）
     Inode dir_inode;
-    if (!readInode(current_dir_inode, dir_inode)) {
+    if (!inodeInUse(session.cwd_inode) || !readInode(session.cwd_inode, dir_inode)) {
+        std::cerr << "错误：当前目录已不存在" << std::endl;
         return false;
     }
     
-    if (!checkPermission(dir_inode, PERM_WRITE)) {
+    if (!checkPermission(session, dir_inode, PERM_WRITE)) {
         std::cerr << "错误：没有写权限" << std::endl;
         return false;
     }
     
-    // 分配新 Inode
-    uint32_t new_inode_id = allocateInode();
+    // 分配新 Inode（按 Orlov 策略选择分配组）
+    uint32_t new_inode_id = allocateInode(session.cwd_inode, true);
     if (new_inode_id == UINT32_MAX) {
         std::cerr << "错误：Inode 已用完" << std::endl;
         return false;
@@ -791,20 +2321,27 @@ bool FileSystem::createDirectory(const std::string& dirname) {
     new_dir_inode.inode_id = new_inode_id;
     new_dir_inode.file_type = FILE_TYPE_DIRECTORY;
     new_dir_inode.permission = DEFAULT_DIR_PERM;
-    new_dir_inode.owner_id = current_user->uid;
+    new_dir_inode.owner_id = session.user.uid;
     new_dir_inode.file_size = 0;
     new_dir_inode.blocks_count = 0;
     new_dir_inode.create_time = time(nullptr);
     new_dir_inode.modify_time = new_dir_inode.create_time;
+    new_dir_inode.parent_id = session.cwd_inode;
     
     if (!writeInode(new_inode_id, new_dir_inode)) {
         freeInode(new_inode_id);
+        commit();
         return false;
     }
     
     // 添加到父目录
-    if (!addDirectoryEntry(current_dir_inode, dirname, new_inode_id)) {
+    if (!addDirectoryEntry(session.cwd_inode, dirname, new_inode_id)) {
         freeInode(new_inode_id);
+        commit();
+        return false;
+    }
+    
+    if (!commit()) {
         return false;
     }
     
@@ -812,68 +2349,122 @@ bool FileSystem::createDirectory(const std::string& dirname) {
     return true;
 }
 
-bool FileSystem::removeFile(const std::string& filename) {
-    if (!current_user) {
+// 是否为当前目录下的名字（不含路径分隔符，也不是 . 或 ..）。
+// 删除操作只对当前目录中的项进行，持有的父目录锁才是被删除对象真正的父目录
+static bool isPlainName(const std::string& name) {
+    return !name.empty() && name != "." && name != ".." && name.find('/') == std::string::npos;
+}
+
+bool FileSystem::removeFile(const Session& session, const std::string& filename) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
+    if (!isPlainName(filename)) {
+        std::cerr << "错误：只能删除当前目录中的文件" << std::endl;
+        return false;
+    }
     
     // 查找文件
-    uint32_t file_inode_id = findInodeByPath(filename);
+    uint32_t file_inode_id = findInodeByPath(session, filename);
     if (file_inode_id == UINT32_MAX) {
         std::cerr << "错误：文件不存在" << std::endl;
         return false;
     }
     
-    Inode file_inode;
-    if (!readInode(file_inode_id, file_inode)) {
+    // 独占文件的跨进程锁：等待其他进程的读写结束（跨进程保护）
+    int lock_handle = lockInodeRange(file_inode_id, true);
+    if (lock_handle < 0) {
+        std::cerr << "错误：文件正在被其他进程使用，暂时无法删除" << std::endl;
         return false;
     }
+    // 再取父目录写锁（文件先于父目录）
+    acquireWriteLock(session.cwd_inode);
+    journal->beginUpdate();
+    bool result = removeFileLocked(session, filename, file_inode_id);
+    journal->endUpdate();
+    releaseWriteLock(session.cwd_inode);
+    unlockInodeRange(file_inode_id, lock_handle);
+    return result;
+}
 
-    // 如果文件正在被写入，则禁止删除（跨进程保护）
-    if (file_inode.state == FILE_STATE_WRITING) {
-        std::cerr << "错误：文件正在被写入，暂时无法删除" << std::endl;
+bool FileSystem::removeFileLocked(const Session& session, const std::string& filename,
+                                  uint32_t file_inode_id) {
+    // 等待锁期间文件可能已被其他线程删除
+    if (!inodeInUse(file_inode_id) ||
+        lookupDirectoryEntry(session.cwd_inode, filename) != file_inode_id) {
+        std::cerr << "错误：文件不存在" << std::endl;
+        return false;
+    }
+    
+    Inode file_inode;
+    if (!reloadInode(file_inode_id, file_inode)) {
         return false;
     }
     
     // 检查权限
-    if (!checkPermission(file_inode, PERM_WRITE)) {
+    if (!checkPermission(session, file_inode, PERM_WRITE)) {
         std::cerr << "错误：没有删除权限" << std::endl;
         return false;
     }
     
     // 释放数据块
-    for (uint32_t i = 0; i < DIRECT_BLOCKS; i++) {
-        if (file_inode.direct_blocks[i] != 0) {
-            freeDataBlock(file_inode.direct_blocks[i]);
-        }
-    }
+    freeInodeBlocks(file_inode);
     
     // 从目录中删除
-    if (!removeDirectoryEntry(current_dir_inode, filename)) {
+    if (!removeDirectoryEntry(session.cwd_inode, filename)) {
+        commit();
         return false;
     }
     
     // 释放 Inode
     freeInode(file_inode_id);
     
+    if (!commit()) {
+        return false;
+    }
+    
     std::cout << "文件 " << filename << " 删除成功" << std::endl;
     return true;
 }
 
-bool FileSystem::removeDirectory(const std::string& dirname) {
-    if (!current_user) {
+bool FileSystem::removeDirectory(const Session& session, const std::string& dirname) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
+    if (!isPlainName(dirname)) {
+        std::cerr << "错误：只能删除当前目录中的子目录" << std::endl;
+        return false;
+    }
     
     // 查找目录
-    uint32_t dir_inode_id = findInodeByPath(dirname);
+    uint32_t dir_inode_id = findInodeByPath(session, dirname);
     if (dir_inode_id == UINT32_MAX) {
         std::cerr << "错误：目录不存在" << std::endl;
         return false;
     }
     
+    // 先锁被删除的目录，再锁父目录：持锁期间没有线程能在其中创建新项
+    acquireWriteLock(dir_inode_id);
+    acquireWriteLock(session.cwd_inode);
+    journal->beginUpdate();
+    bool result = removeDirectoryLocked(session, dirname, dir_inode_id);
+    journal->endUpdate();
+    releaseWriteLock(session.cwd_inode);
+    releaseWriteLock(dir_inode_id);
+    return result;
+}
+
+bool FileSystem::removeDirectoryLocked(const Session& session, const std::string& dirname,
+                                       uint32_t dir_inode_id) {
+    // 等待锁期间目录可能已被其他线程删除
+    if (!inodeInUse(dir_inode_id) ||
+        lookupDirectoryEntry(session.cwd_inode, dirname) != dir_inode_id) {
+        std::cerr << "错误：目录不存在" << std::endl;
+        return false;
+    }
+    
     Inode dir_inode;
     if (!readInode(dir_inode_id, dir_inode)) {
         return false;
@@ -885,38 +2476,42 @@ bool FileSystem::removeDirectory(const std::string& dirname) {
     }
     
     // 检查目录是否为空
-    std::vector<DirectoryEntry> entries = readDirectory(dir_inode_id);
-    if (!entries.empty()) {
+    if (dir_inode.entry_count != 0) {
         std::cerr << "错误：目录不为空" << std::endl;
         return false;
     }
     
     // 检查权限
-    if (!checkPermission(dir_inode, PERM_WRITE)) {
+    if (!checkPermission(session, dir_inode, PERM_WRITE)) {
         std::cerr << "错误：没有删除权限" << std::endl;
         return false;
     }
     
     // 从父目录中删除
-    if (!removeDirectoryEntry(current_dir_inode, dirname)) {
+    if (!removeDirectoryEntry(session.cwd_inode, dirname)) {
         return false;
     }
     
     // 释放 Inode
     freeInode(dir_inode_id);
     
+    if (!commit()) {
+        return false;
+    }
+    
     std::cout << "目录 " << dirname << " 删除成功" << std::endl;
     return true;
 }
 
-bool FileSystem::writeFile(const std::string& filename, const std::string& content) {
-    if (!current_user) {
+bool FileSystem::writeFile(const Session& session, const std::string& filename,
+                           const std::string& content) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
     
     // 查找文件
-    uint32_t file_inode_id = findInodeByPath(filename);
+    uint32_t file_inode_id = findInodeByPath(session, filename);
     if (file_inode_id == UINT32_MAX) {
         std::cerr << "错误：文件不存在" << std::endl;
         return false;
@@ -928,79 +2523,102 @@ bool FileSystem::writeFile(const std::string& filename, const std::string& conte
     }
     
     // 检查权限
-    if (!checkPermission(file_inode, PERM_WRITE)) {
+    if (!checkPermission(session, file_inode, PERM_WRITE)) {
         std::cerr << "错误：没有写权限" << std::endl;
         return false;
     }
 
-    // 先尝试基于磁盘状态的跨进程写锁
+    // 先获取进程内写锁（非交互式场景直接在这里加锁），再获取跨进程写锁
+    acquireWriteLock(file_inode_id);
     if (!beginWrite(file_inode_id)) {
-        // 另一个进程正在写同一文件
+        // 另一个进程长时间占用同一文件
+        releaseWriteLock(file_inode_id);
         return false;
-    }
-
-    // 获取进程内写锁（非交互式场景直接在这里加锁）
-    acquireWriteLock(file_inode_id);
+    }
 
-    // 写入数据
-    bool result = writeInodeData(file_inode, content.c_str(), content.size());
+    // 加锁期间其他进程可能已修改文件，重新读取后再写入
+    journal->beginUpdate();
+    bool result = readInode(file_inode_id, file_inode) &&
+                  writeInodeData(file_inode, content.c_str(), content.size());
     if (result) {
         writeInode(file_inode_id, file_inode);
+    }
+    if (!commit()) {
+        result = false;
+    }
+    if (result) {
         std::cout << "文件写入成功" << std::endl;
     }
 
-    // 释放进程内写锁
-    releaseWriteLock(file_inode_id);
-
-    // 释放跨进程写锁（将状态恢复为 AVAILABLE）
+    // 释放跨进程写锁（修改先刷盘），再释放进程内写锁
     endWrite(file_inode_id);
+    releaseWriteLock(file_inode_id);
 
     return result;
 }
 
 bool FileSystem::beginWrite(uint32_t inode_id) {
-    // 从磁盘读取 inode 的最新状态
-    Inode inode;
-    if (!readInode(inode_id, inode)) {
+    // 在磁盘镜像中该 Inode 的字节范围上加独占锁：
+    // 其他进程的读者和写者都要等待，持有者崩溃时由内核释放
+    int handle = lockInodeRange(inode_id, true);
+    if (handle < 0) {
+        std::cerr << "错误：文件正在被其他进程使用，等待超时" << std::endl;
         return false;
     }
 
-    // 检查文件是否已经被其他进程占用（跨进程写锁）
-    if (inode.state == FILE_STATE_WRITING) {
-        std::cerr << "错误：文件正在被其他进程写入，请稍后再试" << std::endl;
+    // 等待锁期间文件可能已被其他线程删除
+    if (!inodeInUse(inode_id)) {
+        std::cerr << "错误：文件不存在" << std::endl;
+        unlockInodeRange(inode_id, handle);
         return false;
     }
 
-    // 抢占写锁：设置状态为 WRITING 并写回磁盘
-    inode.state = FILE_STATE_WRITING;
-    if (!writeInode(inode_id, inode)) {
-        std::cerr << "错误：无法获取文件写锁" << std::endl;
+    // 加锁后读取最新的 Inode 和数据，并递增写入计数，
+    // 使其他进程下次加锁时知道要丢弃该文件的缓存块
+    Inode inode;
+    if (!reloadInode(inode_id, inode)) {
+        unlockInodeRange(inode_id, handle);
         return false;
     }
+    // 提交时可能刚为延迟分配的数据分配了块，进入事务后按缓存中的 Inode 修改
+    journal->beginUpdate();
+    if (readInode(inode_id, inode)) {
+        inode.generation++;
+        writeInode(inode_id, inode);
+    }
+    journal->endUpdate();
 
+    std::lock_guard<std::mutex> guard(write_handles_mutex);
+    write_handles[inode_id] = handle;
     return true;
 }
 
 void FileSystem::endWrite(uint32_t inode_id) {
-    // 从磁盘读取 inode
-    Inode inode;
-    if (!readInode(inode_id, inode)) {
-        return;
+    int handle;
+    {
+        std::lock_guard<std::mutex> guard(write_handles_mutex);
+        auto it = write_handles.find(inode_id);
+        if (it == write_handles.end()) {
+            return;
+        }
+        handle = it->second;
+        write_handles.erase(it);
     }
 
-    // 释放写锁：设置状态为 AVAILABLE 并写回磁盘
-    inode.state = FILE_STATE_AVAILABLE;
-    writeInode(inode_id, inode);
+    // 修改必须在解锁前刷盘，下一个获得锁的进程才能看到；
+    // periodic/none 模式放弃这一保证，其他进程要等下一次提交后才能看到
+    commit(durability == DURABILITY_SYNC);
+    unlockInodeRange(inode_id, handle);
 }
 
-bool FileSystem::lockFileForWrite(const std::string& filename) {
-    if (!current_user) {
+bool FileSystem::lockFileForWrite(const Session& session, const std::string& filename) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
 
     // 查找文件
-    uint32_t file_inode_id = findInodeByPath(filename);
+    uint32_t file_inode_id = findInodeByPath(session, filename);
     if (file_inode_id == UINT32_MAX) {
         std::cerr << "错误：文件不存在" << std::endl;
         return false;
@@ -1012,43 +2630,45 @@ bool FileSystem::lockFileForWrite(const std::string& filename) {
     }
 
     // 检查写权限
-    if (!checkPermission(file_inode, PERM_WRITE)) {
+    if (!checkPermission(session, file_inode, PERM_WRITE)) {
         std::cerr << "错误：没有写权限" << std::endl;
         return false;
     }
 
-    // 尝试获取跨进程写锁（基于磁盘状态）
+    // 获取进程内写锁（如果已有写者或读者，这里会阻塞，直到可以写）
+    acquireWriteLock(file_inode_id);
+
+    // 再获取跨进程写锁，其他进程占用时等待至超时
     if (!beginWrite(file_inode_id)) {
+        releaseWriteLock(file_inode_id);
         return false;
     }
-
-    // 获取进程内写锁（如果已有写者或读者，这里会阻塞，直到可以写）
-    acquireWriteLock(file_inode_id);
     return true;
 }
 
-void FileSystem::unlockFileForWrite(const std::string& filename) {
+void FileSystem::unlockFileForWrite(const Session& session, const std::string& filename) {
     // 查找文件（如果文件已被删除则直接返回）
-    uint32_t file_inode_id = findInodeByPath(filename);
+    uint32_t file_inode_id = findInodeByPath(session, filename);
     if (file_inode_id == UINT32_MAX) {
         return;
     }
     
+    // 释放跨进程写锁（修改先刷盘）
+    endWrite(file_inode_id);
+    
     // 释放进程内写锁
     releaseWriteLock(file_inode_id);
-    
-    // 释放跨进程写锁（将磁盘状态改回 AVAILABLE）
-    endWrite(file_inode_id);
 }
 
-bool FileSystem::writeFileLocked(const std::string& filename, const std::string& content) {
-    if (!current_user) {
+bool FileSystem::writeFileLocked(const Session& session, const std::string& filename,
+                                 const std::string& content) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
 
     // 查找文件
-    uint32_t file_inode_id = findInodeByPath(filename);
+    uint32_t file_inode_id = findInodeByPath(session, filename);
     if (file_inode_id == UINT32_MAX) {
         std::cerr << "错误：文件不存在" << std::endl;
         return false;
@@ -1060,87 +2680,310 @@ bool FileSystem::writeFileLocked(const std::string& filename, const std::string&
     }
 
     // 再次检查写权限（防御性编程）
-    if (!checkPermission(file_inode, PERM_WRITE)) {
+    if (!checkPermission(session, file_inode, PERM_WRITE)) {
         std::cerr << "错误：没有写权限" << std::endl;
         return false;
     }
 
-    bool result = writeInodeData(file_inode, content.c_str(), content.size());
+    // 进入事务前读到的 Inode 可能已被提交（延迟分配）更新，重新读取后再写入
+    journal->beginUpdate();
+    bool result = readInode(file_inode_id, file_inode) &&
+                  writeInodeData(file_inode, content.c_str(), content.size());
     if (result) {
         writeInode(file_inode_id, file_inode);
+    }
+    if (!commit()) {
+        result = false;
+    }
+    if (result) {
         std::cout << "文件写入成功" << std::endl;
     }
 
     return result;
 }
 
-std::string FileSystem::readFile(const std::string& filename) {
-    if (!current_user) {
+bool FileSystem::appendFile(const Session& session, const std::string& filename,
+                            const std::string& content) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
-        return "";
+        return false;
     }
-    
-    // 查找文件
-    uint32_t file_inode_id = findInodeByPath(filename);
+
+    uint32_t file_inode_id = findInodeByPath(session, filename);
     if (file_inode_id == UINT32_MAX) {
         std::cerr << "错误：文件不存在" << std::endl;
-        return "";
+        return false;
     }
-    
+
     Inode file_inode;
     if (!readInode(file_inode_id, file_inode)) {
-        return "";
+        return false;
+    }
+    if (!checkPermission(session, file_inode, PERM_WRITE)) {
+        std::cerr << "错误：没有写权限" << std::endl;
+        return false;
+    }
+
+    acquireWriteLock(file_inode_id);
+    if (!beginWrite(file_inode_id)) {
+        releaseWriteLock(file_inode_id);
+        return false;
+    }
+
+    bool result = appendFileLocked(session, filename, content);
+
+    endWrite(file_inode_id);
+    releaseWriteLock(file_inode_id);
+
+    return result;
+}
+
+bool FileSystem::appendFileLocked(const Session& session, const std::string& filename,
+                                  const std::string& content) {
+    if (!session.logged_in) {
+        std::cerr << "错误：请先登录" << std::endl;
+        return false;
+    }
+
+    uint32_t file_inode_id = findInodeByPath(session, filename);
+    if (file_inode_id == UINT32_MAX) {
+        std::cerr << "错误：文件不存在" << std::endl;
+        return false;
+    }
+
+    Inode file_inode;
+    if (!readInode(file_inode_id, file_inode)) {
+        return false;
+    }
+    if (file_inode.file_type != FILE_TYPE_REGULAR) {
+        std::cerr << "错误：不是普通文件" << std::endl;
+        return false;
+    }
+    if (!checkPermission(session, file_inode, PERM_WRITE)) {
+        std::cerr << "错误：没有写权限" << std::endl;
+        return false;
+    }
+
+    // 从文件末尾开始写：尾块原地补齐，只为超出部分分配新块。
+    // 进入事务前读到的 Inode 可能已被提交（延迟分配）更新，重新读取
+    journal->beginUpdate();
+    bool result = readInode(file_inode_id, file_inode) &&
+                  writeInodeRange(file_inode, file_inode.file_size,
+                                  content.c_str(), content.size());
+    if (result) {
+        writeInode(file_inode_id, file_inode);
+    }
+    if (!commit()) {
+        result = false;
+    }
+    if (result) {
+        std::cout << "文件追加成功" << std::endl;
     }
 
-    // 如果文件正在被写入，则禁止读取（跨进程保护 cat）
-    if (file_inode.state == FILE_STATE_WRITING) {
-        std::cerr << "错误：文件正在被写入，暂时无法读取" << std::endl;
+    return result;
+}
+
+std::string FileSystem::readFile(const Session& session, const std::string& filename) {
+    if (!session.logged_in) {
+        std::cerr << "错误：请先登录" << std::endl;
         return "";
     }
     
-    // 检查权限
-    if (!checkPermission(file_inode, PERM_READ)) {
-        std::cerr << "错误：没有读权限" << std::endl;
+    // 查找文件
+    uint32_t file_inode_id = findInodeByPath(session, filename);
+    if (file_inode_id == UINT32_MAX) {
+        std::cerr << "错误：文件不存在" << std::endl;
         return "";
     }
     
-    // 获取读锁
+    // 获取进程内读锁，再获取跨进程读锁（其他进程正在写入时等待，跨进程保护 cat）
     acquireReadLock(file_inode_id);
-    
-    // 读取数据
-    char* buffer = new char[file_inode.file_size + 1];
-    memset(buffer, 0, file_inode.file_size + 1);
-    
-    if (!readInodeData(file_inode, buffer, file_inode.file_size)) {
-        delete[] buffer;
+    int lock_handle = lockInodeRange(file_inode_id, false);
+    if (lock_handle < 0) {
         releaseReadLock(file_inode_id);
+        std::cerr << "错误：文件正在被其他进程写入，等待超时" << std::endl;
         return "";
     }
     
-    std::string content(buffer, file_inode.file_size);
-    delete[] buffer;
+    // 加锁后读取最新的 Inode，并检查权限（等待期间文件可能已被删除）
+    Inode file_inode;
+    std::string content;
+    if (!inodeInUse(file_inode_id)) {
+        std::cerr << "错误：文件不存在" << std::endl;
+    } else if (!reloadInode(file_inode_id, file_inode)) {
+        // 读取失败，返回空内容
+    } else if (!checkPermission(session, file_inode, PERM_READ)) {
+        std::cerr << "错误：没有读权限" << std::endl;
+    } else {
+        // 读取数据
+        content.resize(file_inode.file_size);
+        if (!readInodeData(file_inode, &content[0], file_inode.file_size)) {
+            content.clear();
+        }
+    }
     
     // 释放读锁
+    unlockInodeRange(file_inode_id, lock_handle);
     releaseReadLock(file_inode_id);
     
     return content;
 }
 
-bool FileSystem::changeDirectory(const std::string& path) {
-    if (!current_user) {
+int64_t FileSystem::readFileAt(const Session& session, const std::string& filename,
+                               uint64_t offset, char* buffer, uint32_t length) {
+    if (!session.logged_in) {
+        std::cerr << "错误：请先登录" << std::endl;
+        return -1;
+    }
+    
+    uint32_t file_inode_id = findInodeByPath(session, filename);
+    if (file_inode_id == UINT32_MAX) {
+        std::cerr << "错误：文件不存在" << std::endl;
+        return -1;
+    }
+    
+    acquireReadLock(file_inode_id);
+    int lock_handle = lockInodeRange(file_inode_id, false);
+    if (lock_handle < 0) {
+        releaseReadLock(file_inode_id);
+        std::cerr << "错误：文件正在被其他进程写入，等待超时" << std::endl;
+        return -1;
+    }
+    
+    int64_t result = -1;
+    Inode file_inode;
+    if (!inodeInUse(file_inode_id)) {
+        std::cerr << "错误：文件不存在" << std::endl;
+    } else if (!reloadInode(file_inode_id, file_inode)) {
+        // 读取失败
+    } else if (file_inode.file_type != FILE_TYPE_REGULAR) {
+        std::cerr << "错误：不是普通文件" << std::endl;
+    } else if (!checkPermission(session, file_inode, PERM_READ)) {
+        std::cerr << "错误：没有读权限" << std::endl;
+    } else if (offset >= file_inode.file_size) {
+        // 读到文件末尾为止，offset 超出文件大小时返回 0
+        result = 0;
+    } else {
+        uint32_t start = static_cast<uint32_t>(offset);
+        length = std::min(length, file_inode.file_size - start);
+        if (readInodeRange(file_inode, start, buffer, length)) {
+            result = static_cast<int64_t>(length);
+        }
+    }
+    
+    unlockInodeRange(file_inode_id, lock_handle);
+    releaseReadLock(file_inode_id);
+    
+    return result;
+}
+
+int64_t FileSystem::writeFileAt(const Session& session, const std::string& filename,
+                                uint64_t offset, const char* buffer, uint32_t length) {
+    if (!session.logged_in) {
+        std::cerr << "错误：请先登录" << std::endl;
+        return -1;
+    }
+    if (offset + length > MAX_FILE_SIZE) {
+        std::cerr << "错误：文件大小超过限制" << std::endl;
+        return -1;
+    }
+    
+    uint32_t file_inode_id = findInodeByPath(session, filename);
+    if (file_inode_id == UINT32_MAX) {
+        std::cerr << "错误：文件不存在" << std::endl;
+        return -1;
+    }
+    
+    Inode file_inode;
+    if (!readInode(file_inode_id, file_inode)) {
+        return -1;
+    }
+    if (file_inode.file_type != FILE_TYPE_REGULAR) {
+        std::cerr << "错误：不是普通文件" << std::endl;
+        return -1;
+    }
+    if (!checkPermission(session, file_inode, PERM_WRITE)) {
+        std::cerr << "错误：没有写权限" << std::endl;
+        return -1;
+    }
+    
+    acquireWriteLock(file_inode_id);
+    if (!beginWrite(file_inode_id)) {
+        releaseWriteLock(file_inode_id);
+        return -1;
+    }
+    
+    // 加锁期间其他进程可能已修改文件，重新读取后再修改
+    journal->beginUpdate();
+    bool result = readInode(file_inode_id, file_inode) &&
+                  writeInodeRange(file_inode, static_cast<uint32_t>(offset), buffer, length) &&
+                  writeInode(file_inode_id, file_inode);
+    if (!commit()) {
+        result = false;
+    }
+    
+    endWrite(file_inode_id);
+    releaseWriteLock(file_inode_id);
+    
+    return result ? static_cast<int64_t>(length) : -1;
+}
+
+bool FileSystem::truncateFile(const Session& session, const std::string& filename, uint64_t size) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
+    if (size > MAX_FILE_SIZE) {
+        std::cerr << "错误：文件大小超过限制" << std::endl;
+        return false;
+    }
+    
+    uint32_t file_inode_id = findInodeByPath(session, filename);
+    if (file_inode_id == UINT32_MAX) {
+        std::cerr << "错误：文件不存在" << std::endl;
+        return false;
+    }
+    
+    Inode file_inode;
+    if (!readInode(file_inode_id, file_inode)) {
+        return false;
+    }
+    if (file_inode.file_type != FILE_TYPE_REGULAR) {
+        std::cerr << "错误：不是普通文件" << std::endl;
+        return false;
+    }
+    if (!checkPermission(session, file_inode, PERM_WRITE)) {
+        std::cerr << "错误：没有写权限" << std::endl;
+        return false;
+    }
+    
+    acquireWriteLock(file_inode_id);
+    if (!beginWrite(file_inode_id)) {
+        releaseWriteLock(file_inode_id);
+        return false;
+    }
+    
+    journal->beginUpdate();
+    bool result = readInode(file_inode_id, file_inode) &&
+                  truncateInode(file_inode, static_cast<uint32_t>(size)) &&
+                  writeInode(file_inode_id, file_inode);
+    if (!commit()) {
+        result = false;
+    }
     
-    uint32_t target_inode_id;
+    endWrite(file_inode_id);
+    releaseWriteLock(file_inode_id);
     
-    if (path == "..") {
-        // 简化实现：不支持完整的 .. 导航
-        std::cerr << "提示：当前简化实现不完全支持 .." << std::endl;
+    return result;
+}
+
+bool FileSystem::changeDirectory(Session& session, const std::string& path) {
+    if (!session.logged_in) {
+        std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
     
-    target_inode_id = findInodeByPath(path);
+    uint32_t target_inode_id = findInodeByPath(session, path);
     if (target_inode_id == UINT32_MAX) {
         std::cerr << "错误：目录不存在" << std::endl;
         return false;
@@ -1157,130 +3000,229 @@ bool FileSystem::changeDirectory(const std::string& path) {
     }
     
     // 检查执行权限
-    if (!checkPermission(target_inode, PERM_EXEC)) {
+    if (!checkPermission(session, target_inode, PERM_EXEC)) {
         std::cerr << "错误：没有执行权限" << std::endl;
         return false;
     }
     
-    current_dir_inode = target_inode_id;
+    session.cwd_inode = target_inode_id;
     
-    // 更新当前路径
-    if (path[0] == '/') {
-        current_path = path;
-    } else if (current_path == "/") {
-        current_path = "/" + path;
-    } else {
-        current_path = current_path + "/" + path;
+    // 更新当前路径：在原路径（绝对路径时为根）上逐个应用分量，. 与 .. 就地消去
+    std::vector<std::string> parts;
+    size_t pos = 0;
+    std::string component;
+    if (path.empty() || path[0] != '/') {
+        while (nextPathComponent(session.cwd_path, pos, component)) {
+            parts.push_back(component);
+        }
+    }
+    pos = 0;
+    while (nextPathComponent(path, pos, component)) {
+        if (component == "..") {
+            if (!parts.empty()) {
+                parts.pop_back();
+            }
+        } else if (component != ".") {
+            parts.push_back(component);
+        }
+    }
+    session.cwd_path.clear();
+    for (const auto& part : parts) {
+        session.cwd_path += "/" + part;
+    }
+    if (session.cwd_path.empty()) {
+        session.cwd_path = "/";
     }
     
     return true;
 }
 
-std::vector<std::pair<std::string, Inode>> FileSystem::listDirectory(const std::string& path) {
+std::vector<std::pair<std::string, Inode>> FileSystem::listDirectory(const Session& session,
+                                                                     const std::string& path) {
     std::vector<std::pair<std::string, Inode>> result;
-    
-    if (!current_user) {
+    readDirectoryPlus(session, path, [&result](const std::vector<DirEntryPlus>& batch) {
+        for (const auto& entry : batch) {
+            result.push_back({entry.name, entry.inode});
+        }
+        return true;
+    });
+    return result;
+}
+
+bool FileSystem::readDirectoryPlus(const Session& session, const std::string& path,
+                                   const DirBatchCallback& callback, uint32_t batch_size) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
-        return result;
+        return false;
     }
     
-    uint32_t dir_inode_id = current_dir_inode;
-    if (path != ".") {
-        dir_inode_id = findInodeByPath(path);
-        if (dir_inode_id == UINT32_MAX) {
-            std::cerr << "错误：目录不存在" << std::endl;
-            return result;
-        }
+    uint32_t dir_inode_id = findInodeByPath(session, path);
+    if (dir_inode_id == UINT32_MAX) {
+        std::cerr << "错误：目录不存在" << std::endl;
+        return false;
     }
     
+    // 整个遍历期间持目录读锁，callback 中不能修改该目录
+    acquireReadLock(dir_inode_id);
+    bool result = readDirectoryPlusLocked(session, dir_inode_id, callback, batch_size);
+    releaseReadLock(dir_inode_id);
+    return result;
+}
+
+bool FileSystem::readDirectoryPlusLocked(const Session& session, uint32_t dir_inode_id,
+                                         const DirBatchCallback& callback, uint32_t batch_size) {
     Inode dir_inode;
-    if (!readInode(dir_inode_id, dir_inode)) {
-        return result;
+    if (!inodeInUse(dir_inode_id) || !readInode(dir_inode_id, dir_inode)) {
+        std::cerr << "错误：目录不存在" << std::endl;
+        return false;
+    }
+    
+    if (dir_inode.file_type != FILE_TYPE_DIRECTORY) {
+        std::cerr << "错误：不是目录" << std::endl;
+        return false;
     }
     
     // 检查读权限
-    if (!checkPermission(dir_inode, PERM_READ)) {
+    if (!checkPermission(session, dir_inode, PERM_READ)) {
         std::cerr << "错误：没有读权限" << std::endl;
-        return result;
+        return false;
     }
     
-    std::vector<DirectoryEntry> entries = readDirectory(dir_inode_id);
-    for (const auto& entry : entries) {
-        Inode inode;
-        if (readInode(entry.inode_id, inode)) {
-            result.push_back({std::string(entry.filename), inode});
-        }
+    if (batch_size == 0) {
+        batch_size = READDIR_BATCH_SIZE;
     }
+    std::vector<DirectoryEntry> pending;
+    std::vector<uint32_t> order;
+    std::vector<DirEntryPlus> batch;
+    pending.reserve(batch_size);
     
-    return result;
+    // 一批目录项按 Inode 编号排序后读取 Inode：同一 Inode 表块中的 Inode 连续访问，
+    // 结果仍按目录顺序返回；读取失败的目录项跳过
+    auto deliver = [&]() {
+        order.resize(pending.size());
+        for (uint32_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&pending](uint32_t a, uint32_t b) {
+            return pending[a].inode_id < pending[b].inode_id;
+        });
+        std::vector<uint8_t> valid(pending.size(), 0);
+        batch.resize(pending.size());
+        for (uint32_t i : order) {
+            valid[i] = readInode(pending[i].inode_id, batch[i].inode);
+        }
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < pending.size(); i++) {
+            if (valid[i]) {
+                batch[count].name = pending[i].filename;
+                if (count != i) {
+                    batch[count].inode = batch[i].inode;
+                }
+                count++;
+            }
+        }
+        batch.resize(count);
+        pending.clear();
+        return batch.empty() || callback(batch);
+    };
+    
+    bool stopped = false;
+    if (!scanDirectory(dir_inode, [&](const DirectoryEntry& entry) {
+            pending.push_back(entry);
+            if (pending.size() >= batch_size && !deliver()) {
+                stopped = true;
+            }
+            return !stopped;
+        })) {
+        return false;
+    }
+    if (!stopped && !pending.empty()) {
+        deliver();
+    }
+    return true;
 }
 
-bool FileSystem::changePermission(const std::string& filename, uint16_t new_perm) {
-    if (!current_user) {
+bool FileSystem::changePermission(const Session& session, const std::string& filename,
+                                  uint16_t new_perm) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
     
-    uint32_t inode_id = findInodeByPath(filename);
+    uint32_t inode_id = findInodeByPath(session, filename);
     if (inode_id == UINT32_MAX) {
         std::cerr << "错误：文件不存在" << std::endl;
         return false;
     }
     
+    // 持对象的写锁修改 Inode
+    acquireWriteLock(inode_id);
     Inode inode;
-    if (!readInode(inode_id, inode)) {
-        return false;
-    }
-    
-    // 只有所有者和 root 可以修改权限
-    if (!current_user->is_root && inode.owner_id != current_user->uid) {
+    bool result = false;
+    if (!inodeInUse(inode_id) || !readInode(inode_id, inode)) {
+        std::cerr << "错误：文件不存在" << std::endl;
+    } else if (!session.user.is_root && inode.owner_id != session.user.uid) {
+        // 只有所有者和 root 可以修改权限
         std::cerr << "错误：只有所有者可以修改权限" << std::endl;
-        return false;
+    } else {
+        // 提交可能更新了 Inode 的块映射（延迟分配），进入事务后重新读取再修改
+        journal->beginUpdate();
+        result = readInode(inode_id, inode);
+        if (result) {
+            inode.permission = new_perm;
+            inode.modify_time = time(nullptr);
+            result = writeInode(inode_id, inode);
+        }
+        result = commit() && result;
     }
+    releaseWriteLock(inode_id);
     
-    inode.permission = new_perm;
-    inode.modify_time = time(nullptr);
-    
-    if (!writeInode(inode_id, inode)) {
-        return false;
+    if (result) {
+        std::cout << "权限修改成功" << std::endl;
     }
-    
-    std::cout << "权限修改成功" << std::endl;
-    return true;
+    return result;
 }
 
-bool FileSystem::changeOwner(const std::string& filename, uint16_t new_owner) {
-    if (!current_user) {
+bool FileSystem::changeOwner(const Session& session, const std::string& filename,
+                             uint16_t new_owner) {
+    if (!session.logged_in) {
         std::cerr << "错误：请先登录" << std::endl;
         return false;
     }
     
     // 只有 root 可以修改所有者
-    if (!current_user->is_root) {
+    if (!session.user.is_root) {
         std::cerr << "错误：只有 root 可以修改所有者" << std::endl;
         return false;
     }
     
-    uint32_t inode_id = findInodeByPath(filename);
+    uint32_t inode_id = findInodeByPath(session, filename);
     if (inode_id == UINT32_MAX) {
         std::cerr << "错误：文件不存在" << std::endl;
         return false;
     }
     
+    acquireWriteLock(inode_id);
     Inode inode;
-    if (!readInode(inode_id, inode)) {
-        return false;
+    bool result = false;
+    if (!inodeInUse(inode_id) || !readInode(inode_id, inode)) {
+        std::cerr << "错误：文件不存在" << std::endl;
+    } else {
+        journal->beginUpdate();
+        result = readInode(inode_id, inode);
+        if (result) {
+            inode.owner_id = new_owner;
+            inode.modify_time = time(nullptr);
+            result = writeInode(inode_id, inode);
+        }
+        result = commit() && result;
     }
+    releaseWriteLock(inode_id);
     
-    inode.owner_id = new_owner;
-    inode.modify_time = time(nullptr);
-    
-    if (!writeInode(inode_id, inode)) {
-        return false;
+    if (result) {
+        std::cout << "所有者修改成功" << std::endl;
     }
-    
-    std::cout << "所有者修改成功" << std::endl;
-    return true;
+    return result;
 }
 
 std::string FileSystem::permissionToString(uint16_t perm) {
@@ -1304,6 +3246,18 @@ std::string FileSystem::permissionToString(uint16_t perm) {
     return result;
 }
 
+BlockCacheStats FileSystem::getCacheStats() const {
+    return cache->getStats();
+}
+
+uint64_t FileSystem::getDentryHits() const {
+    return dentry_cache->getHits();
+}
+
+uint64_t FileSystem::getDentryMisses() const {
+    return dentry_cache->getMisses();
+}
+
 std::string FileSystem::getFileInfo(const Inode& inode) {
     std::ostringstream oss;
     
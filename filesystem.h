@@ -6,21 +6,43 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <atomic>
 #include <mutex>
+#include <thread>
 #include <condition_variable>
-#include <fstream>
-#include <memory>
+#include "virtualdisk.h"
+#include "bitmap.h"
 
 // ============= 常量定义 =============
-const uint32_t DISK_SIZE = 10 * 1024 * 1024;  // 10MB 虚拟磁盘
-const uint32_t BLOCK_SIZE = 4096;              // 4KB 块大小
+const uint32_t FS_MAGIC = 0x45585446;          // 魔数（"FTXE"，extent 格式）
 const uint32_t INODE_SIZE = 128;               // Inode 大小
-const uint32_t MAX_BLOCKS = DISK_SIZE / BLOCK_SIZE;
-const uint32_t MAX_INODES = 1024;              // 最大 Inode 数量
+const uint32_t DEFAULT_INODES = 1024;          // 未指定 Inode 数量时的最少 Inode 数
+const uint32_t MAX_INODES = UINT32_MAX / INODE_SIZE;  // Inode 表的字节偏移不超过 32 位
+const uint32_t BYTES_PER_INODE = 16384;        // 未指定 Inode 数量时每 16KB 空间一个 Inode
 const uint32_t MAX_FILENAME = 28;              // 文件名最大长度
-const uint32_t MAX_FILE_SIZE = 1024 * 1024;    // 单个文件最大 1MB
-const uint32_t DIRECT_BLOCKS = 10;             // 直接块指针数量
-const uint32_t INDIRECT_BLOCKS = 1;            // 间接块指针数量
+const uint32_t MAX_FILE_SIZE = 0xFFFFFFFFu / BLOCK_SIZE * BLOCK_SIZE;  // 受 Inode 中 32 位文件大小限制
+const uint32_t INLINE_EXTENTS = 8;             // Inode 内联的 extent 数量
+const uint32_t JOURNAL_BLOCKS = 128;           // 元数据日志区最少块数（512KB）
+const uint32_t MAX_JOURNAL_BLOCKS = 8192;      // 元数据日志区最多块数（32MB）
+const uint32_t MIN_DATA_BLOCKS = 64;           // 格式化后至少留下的数据块数（256KB）
+const uint32_t BITS_PER_BLOCK = BLOCK_SIZE * 8;  // 一个位图块管理的位数
+const uint32_t MAX_GROUP_BLOCKS = BITS_PER_BLOCK;  // 分配组最多块数（128MB，一个位图块）
+const uint32_t MIN_GROUP_BLOCKS = 1024;        // 分配组最少块数（4MB）
+const uint32_t TARGET_GROUPS = 8;              // 小磁盘上至少划分的分配组数
+const uint32_t DELAYED_FILE_BLOCKS = 2048;     // 单个文件最多延迟分配的块数（8MB）
+const uint32_t DELAYED_TOTAL_BLOCKS = 8192;    // 所有文件延迟分配缓冲的总块数（32MB）
+
+// ============= 持久性模式（挂载时生效）=============
+enum DurabilityMode {
+    DURABILITY_SYNC = 0,      // 每次操作提交日志事务并 fdatasync（默认）
+    DURABILITY_PERIODIC = 1,  // 后台线程每隔一段时间提交并刷盘，崩溃最多丢失一个周期
+    DURABILITY_NONE = 2       // 只在日志写满、sync 和卸载时提交，且不等待落盘
+};
+const uint32_t DEFAULT_FLUSH_INTERVAL_MS = 5000;  // periodic 模式的默认刷盘周期
 
 // ============= 文件类型 =============
 enum FileType {
@@ -28,12 +50,6 @@ enum FileType {
     FILE_TYPE_DIRECTORY = 1 // 目录
 };
 
-// ============= 文件状态（用于跨进程写锁）=============
-enum FileState {
-    FILE_STATE_AVAILABLE = 0,  // 可用
-    FILE_STATE_WRITING = 1     // 正在写入
-};
-
 // ============= 权限位定义 =============
 const uint16_t PERM_READ = 0x04;   // r--
 const uint16_t PERM_WRITE = 0x02;  // -w-
@@ -54,10 +70,17 @@ const uint16_t PERM_OTHER_X = PERM_EXEC;
 const uint16_t DEFAULT_DIR_PERM = 0755;  // rwxr-xr-x
 const uint16_t DEFAULT_FILE_PERM = 0644; // rw-r--r--
 
+// 管理 bits 个对象的位图占用的块数
+inline uint32_t bitmapBlocks(uint32_t bits) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(bits) + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK);
+}
+
 // ============= 超级块 =============
+// 磁盘布局由格式化时的磁盘大小和 Inode 数决定，各区域的起始块记录在超级块中，
+// 位图和 Inode 表的块数由总块数、总 Inode 数推出。挂载时只依据超级块，不依赖编译期常量
 struct SuperBlock {
     uint32_t magic_number;       // 魔数，用于识别文件系统
-    uint32_t disk_size;          // 磁盘总大小
+    uint32_t disk_size;          // 磁盘总大小（低 32 位）
     uint32_t block_size;         // 块大小
     uint32_t total_blocks;       // 总块数
     uint32_t total_inodes;       // 总 Inode 数
@@ -67,55 +90,145 @@ struct SuperBlock {
     uint32_t data_bitmap_block;  // 数据块位图起始块
     uint32_t inode_table_block;  // Inode 表起始块
     uint32_t data_block_start;   // 数据块起始位置
-    char padding[4052];          // 填充到 4096 字节
+    uint32_t journal_block;      // 日志区起始块（旧镜像为 0：不记日志）
+    uint32_t journal_blocks;     // 日志区块数
+    uint32_t disk_size_high;     // 磁盘总大小（高 32 位）
+    uint32_t blocks_per_group;   // 每个分配组的块数（64 的倍数）
+    uint32_t inodes_per_group;   // 每个分配组的 Inode 数（64 的倍数）
+    uint32_t group_count;        // 分配组数
+    char padding[4028];          // 填充到 4096 字节
 
-    SuperBlock() {
-        magic_number = 0x12345678;
-        disk_size = DISK_SIZE;
+    SuperBlock(uint64_t size = DEFAULT_DISK_SIZE, uint32_t inodes = DEFAULT_INODES) {
+        magic_number = FS_MAGIC;
         block_size = BLOCK_SIZE;
-        total_blocks = MAX_BLOCKS;
-        total_inodes = MAX_INODES;
-        free_blocks = total_blocks - 10; // 预留一些块给系统
-        free_inodes = total_inodes - 1;  // 根目录占用一个
+        total_blocks = static_cast<uint32_t>(size / BLOCK_SIZE);
+        uint64_t bytes = static_cast<uint64_t>(total_blocks) * BLOCK_SIZE;
+        disk_size = static_cast<uint32_t>(bytes);
+        disk_size_high = static_cast<uint32_t>(bytes >> 32);
+        total_inodes = inodes;
+        
+        // [超级块] [Inode 位图] [数据块位图] [Inode 表] [日志区] [数据块区域]
         inode_bitmap_block = 1;
-        data_bitmap_block = 2;
-        inode_table_block = 3;
-        data_block_start = 3 + (MAX_INODES * INODE_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        data_bitmap_block = inode_bitmap_block + bitmapBlocks(total_inodes);
+        inode_table_block = data_bitmap_block + bitmapBlocks(total_blocks);
+        uint64_t table_blocks = (static_cast<uint64_t>(total_inodes) * INODE_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        journal_block = static_cast<uint32_t>(inode_table_block + table_blocks);
+        journal_blocks = std::min(std::max(total_blocks / 256, JOURNAL_BLOCKS), MAX_JOURNAL_BLOCKS);
+        data_block_start = journal_block + journal_blocks;
+        
+        free_blocks = total_blocks > data_block_start ? total_blocks - data_block_start : 0;
+        free_inodes = total_inodes;      // 根目录由格式化时分配
+        initGroups();
         memset(padding, 0, sizeof(padding));
     }
+    
+    // 划分分配组：大磁盘每组 MAX_GROUP_BLOCKS 块，小磁盘至少 TARGET_GROUPS 组；
+    // Inode 平均分给各组。组边界按 64 位对齐，相邻两组不会共用位图中的同一个字
+    void initGroups() {
+        uint64_t per_group = (static_cast<uint64_t>(total_blocks) / TARGET_GROUPS + 63) / 64 * 64;
+        blocks_per_group = static_cast<uint32_t>(
+            std::min<uint64_t>(std::max<uint64_t>(per_group, MIN_GROUP_BLOCKS), MAX_GROUP_BLOCKS));
+        group_count = std::max(1u, (total_blocks + blocks_per_group - 1) / blocks_per_group);
+        uint64_t inodes = (static_cast<uint64_t>(total_inodes) + group_count - 1) / group_count;
+        inodes_per_group = static_cast<uint32_t>(std::max<uint64_t>((inodes + 63) / 64 * 64, 64));
+    }
+    
+    uint64_t diskSize() const { return (static_cast<uint64_t>(disk_size_high) << 32) | disk_size; }
+    uint32_t inodeTableBlocks() const {
+        return static_cast<uint32_t>((static_cast<uint64_t>(total_inodes) * INODE_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    }
+};
+
+// ============= 分配组 =============
+// 数据块按 blocks_per_group、Inode 按 inodes_per_group 划分为若干组，
+// 每组只管理两张位图中属于自己的一段，由组内的互斥锁保护，不同组的分配互不阻塞。
+// 空闲计数为原子变量：放置策略无锁读取各组的近似值，只在选定的组内加锁分配。
+// 挂载时由位图统计各组的空闲计数，超级块中的总数在提交时由各组汇总。
+struct AllocGroup {
+    std::mutex mutex;
+    uint32_t first_block;              // 组内可分配的数据块 [first_block, end_block)
+    uint32_t end_block;
+    uint32_t first_inode;              // 组内的 Inode [first_inode, end_inode)
+    uint32_t end_inode;
+    uint32_t block_cursor;             // next-fit 游标
+    uint32_t inode_cursor;
+    std::atomic<uint32_t> free_blocks;
+    std::atomic<uint32_t> free_inodes;
+    bool block_bitmap_dirty;           // 本组的位图段在提交时需要写回
+    bool inode_bitmap_dirty;
+
+    AllocGroup() : first_block(0), end_block(0), first_inode(0), end_inode(0),
+                   block_cursor(0), inode_cursor(0), free_blocks(0), free_inodes(0),
+                   block_bitmap_dirty(false), inode_bitmap_dirty(false) {}
+};
+
+// ============= Extent（连续块区间）=============
+struct Extent {
+    uint32_t start_block;  // 起始物理块号
+    uint32_t length;       // 连续块数
 };
 
+const uint32_t EXTENTS_PER_BLOCK = BLOCK_SIZE / sizeof(Extent);       // 一个 extent 块可容纳的 extent 数
+const uint32_t INDEX_ENTRIES = BLOCK_SIZE / sizeof(uint32_t);        // 二级索引块可容纳的块号数
+const uint32_t MAX_EXTENTS = 0xFFFF;                                  // 受 16 位 extent_count 限制
+const uint32_t BLOCK_MAP_CACHE_SIZE = 64;                             // 缓存块映射表的文件数
+const int DEFAULT_LOCK_TIMEOUT_MS = 5000;                             // 跨进程锁默认等待时间
+
+const uint8_t INODE_FLAG_HASHED_DIR = 0x01;                           // 目录使用哈希索引格式
+
 // ============= Inode 结构 =============
+// 文件数据由按逻辑顺序排列的 extent 描述，分三级存放：
+//   1. 前 INLINE_EXTENTS 个内联在 Inode 中；
+//   2. 接下来 EXTENTS_PER_BLOCK 个存放在一级溢出块 extent_block 中；
+//   3. 其余存放在二级索引块 extent_index_block 所指向的各个 extent 块中。
 struct Inode {
     uint32_t inode_id;                  // Inode 编号
     uint8_t file_type;                  // 文件类型（普通文件/目录）
-    uint8_t state;                      // 文件状态（用于跨进程写锁）
+    uint8_t state;                      // 保留（曾用作跨进程写锁状态，已废弃）
     uint16_t permission;                // 权限（rwx）
     uint16_t owner_id;                  // 所有者 UID
+    uint16_t extent_count;              // extent 总数（含溢出块中的）
     uint32_t file_size;                 // 文件大小（字节）
-    uint32_t blocks_count;              // 占用的块数
-    uint32_t direct_blocks[DIRECT_BLOCKS];    // 直接块指针
-    uint32_t indirect_block;            // 一级间接块指针
+    uint32_t blocks_count;              // 占用的数据块数
+    Extent extents[INLINE_EXTENTS];     // 内联 extent
+    uint32_t extent_block;              // 一级溢出 extent 块（0 表示无）
     uint32_t create_time;               // 创建时间
     uint32_t modify_time;               // 修改时间
-    char padding[35];                   // 填充到 128 字节（减少1字节给state）
+    uint32_t extent_index_block;        // 二级索引块（0 表示无）
+    uint8_t flags;                      // INODE_FLAG_*
+    uint8_t reserved[3];
+    uint32_t parent_id;                 // 目录的父目录 Inode（根目录指向自身）
+    uint32_t entry_count;               // 目录的有效目录项数
+    uint32_t free_slot;                 // 线性目录中第一个可能空闲的槽位
+    uint32_t generation;                // 写入计数：每次获取跨进程写锁时加一
+    char padding[8];                    // 填充到 128 字节
 
     Inode() {
         inode_id = 0;
         file_type = FILE_TYPE_REGULAR;
-        state = FILE_STATE_AVAILABLE;
+        state = 0;
         permission = DEFAULT_FILE_PERM;
         owner_id = 0;
+        extent_count = 0;
         file_size = 0;
         blocks_count = 0;
-        memset(direct_blocks, 0, sizeof(direct_blocks));
-        indirect_block = 0;
+        memset(extents, 0, sizeof(extents));
+        extent_block = 0;
+        extent_index_block = 0;
         create_time = 0;
         modify_time = 0;
+        flags = 0;
+        memset(reserved, 0, sizeof(reserved));
+        parent_id = 0;
+        entry_count = 0;
+        free_slot = 0;
+        generation = 0;
         memset(padding, 0, sizeof(padding));
     }
 };
 
+static_assert(sizeof(Inode) == INODE_SIZE, "Inode 必须正好占用 INODE_SIZE 字节");
+
 // ============= 目录项 =============
 struct DirectoryEntry {
     char filename[MAX_FILENAME];  // 文件名
@@ -133,6 +246,61 @@ struct DirectoryEntry {
     }
 };
 
+// ============= 哈希目录 =============
+// 目录项不超过 DIR_LINEAR_MAX 个时按线性数组存放，删除的槽位置空（文件名为空）留作复用；
+// 超过后转换为哈希索引格式：
+//   逻辑块 0 为根索引块，按名字哈希的下界有序记录子块；
+//   根块的子块是叶子块（levels = 0），或再经过一层索引节点块（levels = 1）；
+//   叶子块第 0 个槽位为块头，其余槽位紧凑存放目录项。
+// 查找/插入/删除只访问根块、至多一个索引节点块和一个叶子块。
+const uint32_t DIR_ROOT_MAGIC = 0x544f4f52;    // "ROOT"
+const uint32_t DIR_NODE_MAGIC = 0x45444f4e;    // "NODE"
+const uint32_t DIR_LEAF_MAGIC = 0x4641454c;    // "LEAF"
+const uint32_t DIR_LINEAR_MAX = BLOCK_SIZE / sizeof(DirectoryEntry);  // 线性格式最多一个块
+
+struct DirIndexHeader {
+    uint32_t magic;
+    uint16_t levels;        // 仅根块有效：索引节点层数（0 或 1）
+    uint16_t count;         // 本块中的索引项数
+    uint32_t reserved[2];
+};
+
+struct DirIndexEntry {
+    uint32_t hash;          // 子块负责的最小哈希值
+    uint32_t block;         // 子块在目录中的逻辑块号
+};
+
+const uint32_t DIR_INDEX_CAPACITY = (BLOCK_SIZE - sizeof(DirIndexHeader)) / sizeof(DirIndexEntry);
+
+struct DirIndexBlock {
+    DirIndexHeader header;
+    DirIndexEntry entries[DIR_INDEX_CAPACITY];
+};
+
+struct DirLeafHeader {
+    uint32_t magic;
+    uint32_t count;         // 有效目录项数
+    char reserved[sizeof(DirectoryEntry) - 8];
+};
+
+const uint32_t DIR_LEAF_CAPACITY = BLOCK_SIZE / sizeof(DirectoryEntry) - 1;
+
+struct DirLeafBlock {
+    DirLeafHeader header;
+    DirectoryEntry entries[DIR_LEAF_CAPACITY];
+};
+
+static_assert(sizeof(DirIndexBlock) == BLOCK_SIZE, "索引块必须正好占用一个块");
+static_assert(sizeof(DirLeafBlock) == BLOCK_SIZE, "叶子块必须正好占用一个块");
+
+// ============= readdirplus 结果项 =============
+const uint32_t READDIR_BATCH_SIZE = 128;        // 每批返回的目录项数
+
+struct DirEntryPlus {
+    std::string name;
+    Inode inode;
+};
+
 // ============= 用户信息 =============
 struct User {
     uint16_t uid;
@@ -145,126 +313,284 @@ struct User {
         : uid(id), username(name), password(pwd), is_root(root) {}
 };
 
-// ============= 打开文件表项 =============
-struct OpenFileEntry {
-    uint32_t inode_id;
-    int reader_count;          // 当前读者数量
-    bool is_writing;           // 是否有写者
-    std::mutex mutex;          // 保护本结构的互斥锁
-    std::condition_variable cv; // 条件变量
+// ============= 会话 =============
+// 一个登录用户的上下文：凭据和当前工作目录。文件操作都在某个会话中进行，
+// 同一个 FileSystem 可以同时服务多个会话，它们共享缓存和锁
+struct Session {
+    bool logged_in;
+    User user;                         // 登录时复制的用户信息（不含密码）
+    uint32_t cwd_inode;                // 当前目录的 Inode 编号
+    std::string cwd_path;              // 当前路径
 
-    OpenFileEntry() : inode_id(0), reader_count(0), is_writing(false) {}
+    Session() : logged_in(false), cwd_inode(0), cwd_path("/") {}
 };
 
-// ============= 虚拟磁盘类 =============
-class VirtualDisk {
-private:
-    std::string disk_filename;
-    std::fstream disk_file;
-
-public:
-    VirtualDisk(const std::string& filename);
-    ~VirtualDisk();
-
-    bool format();  // 格式化磁盘
-    bool readBlock(uint32_t block_num, char* buffer);
-    bool writeBlock(uint32_t block_num, const char* buffer);
-    bool isOpen() const;
-};
+class BlockCache;
+class InodeCache;
+class DentryCache;
+class Journal;
+class LockTable;
+struct BlockCacheStats;
 
 // ============= 文件系统类 =============
+// 线程安全：除 format/mount 外的接口可以被多个线程同时调用（各自使用自己的会话）。
+// 锁的层次（先取前者）：
+//   1. 文件/目录锁（LockTable，按 Inode）：操作对象先于其父目录；
+//      路径解析逐级对目录加读锁，同一时刻只持有一级
+//   2. 提交锁 commit_mutex；修改操作在取得文件/目录锁之后进入日志事务（beginUpdate）
+//   3. 分配组锁 AllocGroup::mutex（同时持有多个时按组号递增，只有写回位图时需要）
+//   4. 延迟分配表锁 delayed_mutex（其后可取 Inode 缓存的锁）
+//   5. 各缓存内部的互斥锁（Inode 缓存、日志、块缓存依次），以及块映射、用户表的互斥锁
 class FileSystem {
 private:
     VirtualDisk* disk;
+    BlockCache* cache;                 // 块缓存（所有块读写都经过缓存）
+    InodeCache* inode_cache;           // 常驻内存的 Inode 表
+    DentryCache* dentry_cache;         // (父目录, 文件名) -> Inode 的查找缓存
+    Journal* journal;                  // 元数据预写日志
     SuperBlock super_block;
-    std::vector<bool> inode_bitmap;    // Inode 位图
-    std::vector<bool> data_bitmap;     // 数据块位图
+    Bitmap inode_bitmap;               // Inode 位图（各分配组各管一段）
+    Bitmap data_bitmap;                // 数据块位图（各分配组各管一段）
+    std::unique_ptr<AllocGroup[]> groups;  // 分配器状态只在内存中修改，提交时才写回
+    uint32_t group_count;
+    std::atomic<uint32_t> spread_group;  // 顶层目录轮转放置的起点
+    bool super_block_dirty;            // 只在格式化和提交时访问（持有提交锁）
+    uint32_t commit_interval;          // 每多少次操作提交一次日志事务
+    uint32_t pending_commits;
+    std::mutex commit_mutex;           // 提交点互斥，保护 pending_commits，串行化事务提交
+    DurabilityMode durability;
+    uint32_t flush_interval_ms;
+    
+    // 后台刷盘线程（periodic 模式）
+    std::thread flusher;
+    std::mutex flusher_mutex;
+    std::condition_variable flusher_cv;
+    bool flusher_stop;
     
     // 用户管理
     std::map<uint16_t, User> users;    // UID -> User
-    User* current_user;                // 当前登录用户
+    std::mutex users_mutex;
     
-    // 当前工作目录
-    uint32_t current_dir_inode;        // 当前目录的 Inode 编号
-    std::string current_path;          // 当前路径
+    // 进程内文件读写锁（用于并发控制）
+    LockTable* lock_table;
     
-    // 打开文件表（用于并发控制）
-    std::map<uint32_t, std::shared_ptr<OpenFileEntry>> open_files;
-    std::mutex open_files_mutex;
+    // 跨进程文件锁：磁盘镜像中 Inode 所在字节范围上的 OFD 锁
+    int lock_timeout_ms;               // 等待超时（毫秒），小于 0 表示一直等待
+    std::mutex write_handles_mutex;
+    std::map<uint32_t, int> write_handles;  // beginWrite 持有的锁句柄，endWrite 时释放
+    
+    // 块映射缓存：Inode 编号 -> 逻辑块到物理块的映射表，热点文件的偏移换算为 O(1)。
+    // 映射表以共享指针交给调用者，缓存项被替换或淘汰时正在使用的副本仍然有效
+    typedef std::shared_ptr<const std::vector<uint32_t>> BlockMapRef;
+    struct BlockMap {
+        Inode source;                  // 生成映射表时的 Inode，用于校验是否过期
+        BlockMapRef blocks;
+    };
+    std::map<uint32_t, BlockMap> block_maps;
+    std::mutex block_maps_mutex;
+    
+    // 延迟分配（periodic/none 模式）：写到已分配块之后的普通文件数据先留在内存中，
+    // 只预留空间、不选块号，提交时按整段大小一次分配并写出；提交前删除的文件不会动位图。
+    // 尾部缓冲由持有文件写锁的线程修改，读者以共享指针取得快照
+    struct DelayedTail {
+        std::vector<char> data;        // 从逻辑块 blocks_count 起的整块内容，文件末尾之后为 0
+    };
+    std::map<uint32_t, std::shared_ptr<DelayedTail>> delayed;  // Inode 编号 -> 尾部缓冲
+    std::mutex delayed_mutex;
+    std::atomic<uint32_t> delayed_blocks;  // 所有尾部缓冲占用（即预留）的块数
 
     // 内部辅助函数
     bool loadSuperBlock();
     bool saveSuperBlock();
+    bool applyGeometry();              // 按超级块调整位图、分配组、锁表和 Inode 缓存
     bool loadBitmaps();
     bool saveBitmaps();
+    bool loadBitmap(Bitmap& bitmap, uint32_t start_block);
+    // 写回 blocks 中的位图块；写每块时锁住与之重叠的分配组（每组 group_bits 位）
+    bool saveBitmap(const Bitmap& bitmap, uint32_t start_block, const std::set<uint32_t>& blocks,
+                    uint32_t group_bits);
+    // 把 [first, first + count) 所在的位图块加入 blocks
+    void markBitmapDirty(std::set<uint32_t>& blocks, uint32_t first, uint32_t count);
+    void countGroups();                // 由位图统计各组的空闲计数
+    bool syncMetadata();               // 把脏位图/超级块写入缓存
+    bool commit(bool force = false);   // 结束修改操作：按提交间隔提交日志事务并刷盘
+    void startFlusher();
+    void stopFlusher();
+    void flusherLoop();
     
-    uint32_t allocateInode();
+    AllocGroup& groupOfBlock(uint32_t block_id) { return groups[block_id / super_block.blocks_per_group]; }
+    AllocGroup& groupOfInode(uint32_t inode_id) { return groups[inode_id / super_block.inodes_per_group]; }
+    // Orlov 式放置：根目录下的新目录分散到较空的组，其余目录和文件留在父目录所在的组
+    uint32_t findInodeGroup(uint32_t parent_id, bool directory);
+    uint32_t allocateInode(uint32_t parent_id, bool directory);
     void freeInode(uint32_t inode_id);
-    uint32_t allocateDataBlock();
+    // 数据块优先分配在 inode_id 所在的组（文件数据靠近其 Inode 和同目录的文件）
+    uint32_t allocateDataBlock(uint32_t inode_id);
+    // 分配 count 个数据块，尽量整段连续；结果追加到 extents（相邻区间合并）
+    bool allocateExtents(uint32_t inode_id, uint32_t count, std::vector<Extent>& extents);
+    void freeExtent(const Extent& extent);
     void freeDataBlock(uint32_t block_id);
+    void releaseBlocks(uint32_t start, uint32_t count);  // 按组加锁释放一段块
+    uint64_t freeBlockCount();         // 各组空闲块数之和（含延迟分配预留的块）
+    bool inodeInUse(uint32_t inode_id);        // 加锁后确认对象未被其他线程删除
     
     bool readInode(uint32_t inode_id, Inode& inode);
     bool writeInode(uint32_t inode_id, const Inode& inode);
+    bool reloadInode(uint32_t inode_id, Inode& inode);  // 绕过缓存读取（跨进程状态）
+    bool refreshInodeBlocks(const Inode& inode);         // 重新读取文件的映射块和数据块
+    
+    // extent 映射
+    bool loadExtents(const Inode& inode, std::vector<Extent>& extents);
+    bool storeExtents(Inode& inode, const std::vector<Extent>& extents);
+    bool readExtentBlock(uint32_t block_num, uint32_t count, std::vector<Extent>& extents);
+    // 按需在 inode_id 所在的组中分配
+    bool writeMetadataBlock(uint32_t inode_id, uint32_t& block_num, const void* data, size_t bytes);
+    bool mapInodeBlocks(const Inode& inode, std::vector<uint32_t>& blocks);  // 逻辑块 -> 物理块
+    BlockMapRef getBlockMap(const Inode& inode);                           // 经缓存的映射表
+    uint32_t lookupBlock(const Inode& inode, uint32_t logical_block);       // 失败返回 UINT32_MAX
+    void invalidateBlockMap(uint32_t inode_id);
+    void freeInodeBlocks(Inode& inode);   // 释放全部数据块及 extent 元数据块
     
+    bool growInode(Inode& inode, uint32_t block_count);  // 在文件末尾追加分配块
+    // 延迟分配：把尾部缓冲调整为文件大小 size，再拷入 [offset, offset + length) 的数据
+    // （offset 不小于已分配部分）；超出缓冲上限或空间不足时返回 false，由调用者立即分配
+    bool bufferTail(Inode& inode, uint32_t size, uint32_t offset, const char* data, uint32_t length);
+    // 为文件的尾部缓冲一次性分配块并写出；publish 时同时写回 Inode（提交时，读者可能并发）
+    bool allocateDelayed(Inode& inode, bool publish);
+    void dropDelayed(uint32_t inode_id);  // 丢弃尾部缓冲并释放预留
+    bool flushDelayed();               // 提交时为所有尾部缓冲分配块
+    // 只访问 [offset, offset + length) 涉及的块，首尾不完整的块读-改-写
+    bool readInodeRange(const Inode& inode, uint32_t offset, char* buffer, uint32_t length);
+    bool writeInodeRange(Inode& inode, uint32_t offset, const char* buffer, uint32_t length);
+    bool truncateInode(Inode& inode, uint32_t size);
     bool readInodeData(const Inode& inode, char* buffer, uint32_t size);
-    bool writeInodeData(Inode& inode, const char* buffer, uint32_t size);
+    bool writeInodeData(Inode& inode, const char* buffer, uint32_t size);  // 整体覆盖
     
     bool addDirectoryEntry(uint32_t dir_inode_id, const std::string& name, uint32_t inode_id);
     bool removeDirectoryEntry(uint32_t dir_inode_id, const std::string& name);
     std::vector<DirectoryEntry> readDirectory(uint32_t dir_inode_id);
+    // 逐项访问目录中的有效目录项，visit 返回 false 时提前结束
+    bool scanDirectory(const Inode& dir_inode, const std::function<bool(const DirectoryEntry&)>& visit);
+    uint32_t countDirectoryEntries(const Inode& dir_inode);
+    uint32_t lookupDirectoryEntry(uint32_t dir_inode_id, const std::string& name);  // 失败返回 UINT32_MAX
+    uint32_t scanDirectoryEntry(uint32_t dir_inode_id, const std::string& name);    // 不经过目录项缓存
     
-    uint32_t findInodeByPath(const std::string& path);
-    bool checkPermission(const Inode& inode, uint16_t required_perm);
+    // 哈希目录索引
+    bool readDirectoryBlock(const Inode& dir_inode, uint32_t logical_block, void* buffer);
+    bool writeDirectoryBlock(const Inode& dir_inode, uint32_t logical_block, const void* buffer);
+    uint32_t appendDirectoryBlock(Inode& dir_inode);  // 返回新块的逻辑块号，失败返回 UINT32_MAX
+    // 返回负责 hash 的叶子块，parent 为引用它的索引块（0 表示根块）
+    uint32_t findDirectoryLeaf(const Inode& dir_inode, uint32_t hash, uint32_t& parent);
+    bool convertToHashedDirectory(Inode& dir_inode);
+    bool insertHashedEntry(Inode& dir_inode, const DirectoryEntry& entry);
+    bool removeHashedEntry(Inode& dir_inode, const std::string& name);
+    bool splitDirectoryLeaf(Inode& dir_inode, uint32_t leaf, uint32_t parent);
+    bool insertDirectoryIndex(Inode& dir_inode, uint32_t parent, uint32_t hash, uint32_t child);
+    // 线性目录：从 start 起查找文件名为 name 的槽位（name 为空时查找空槽位），
+    // 找不到返回槽位总数
+    uint32_t scanLinearDirectory(const Inode& dir_inode, uint32_t start, const std::string& name,
+                                 DirectoryEntry* found);
+    bool trimDirectoryTail(Inode& dir_inode);                // 回收末尾连续的空槽位
+    
+    // 以下 *Locked 函数在调用者已持有父目录（及操作对象）的锁时执行实际操作
+    bool createFileLocked(const Session& session, const std::string& filename);
+    bool createDirectoryLocked(const Session& session, const std::string& dirname);
+    bool removeFileLocked(const Session& session, const std::string& filename,
+                          uint32_t file_inode_id);
+    bool removeDirectoryLocked(const Session& session, const std::string& dirname,
+                               uint32_t dir_inode_id);
+    bool readDirectoryPlusLocked(const Session& session, uint32_t dir_inode_id,
+                                 const std::function<bool(const std::vector<DirEntryPlus>&)>& callback,
+                                 uint32_t batch_size);
+    uint32_t findInodeByPath(const Session& session, const std::string& path);
+    bool checkPermission(const Session& session, const Inode& inode, uint16_t required_perm);
     
     // 并发控制
     void acquireReadLock(uint32_t inode_id);
     void releaseReadLock(uint32_t inode_id);
     void acquireWriteLock(uint32_t inode_id);
     void releaseWriteLock(uint32_t inode_id);
+    int lockInodeRange(uint32_t inode_id, bool exclusive);      // 失败返回 -1
+    void unlockInodeRange(uint32_t inode_id, int handle);
 
 public:
-    FileSystem(const std::string& disk_file);
+    FileSystem(const std::string& disk_file, DiskBackend backend = DISK_BACKEND_FSTREAM,
+               bool direct_io = false);
     ~FileSystem();
 
     // 初始化和格式化
-    bool format();
+    // 格式化：disk_size 为 0 时沿用镜像当前大小，inode_count 为 0 时按每 BYTES_PER_INODE
+    // 字节一个 Inode 计算（至少 DEFAULT_INODES 个）；块大小目前只支持 BLOCK_SIZE
+    bool format(uint64_t disk_size = 0, uint32_t block_size = BLOCK_SIZE, uint32_t inode_count = 0);
     bool mount();
     
     // 用户管理
     bool addUser(const std::string& username, const std::string& password, bool is_root = false);
-    bool login(const std::string& username, const std::string& password);
-    void logout();
-    User* getCurrentUser() const { return current_user; }
+    bool login(Session& session, const std::string& username, const std::string& password);
+    void logout(Session& session);
     
     // 文件操作
-    bool createFile(const std::string& filename);
-    bool createDirectory(const std::string& dirname);
-    bool removeFile(const std::string& filename);
-    bool removeDirectory(const std::string& dirname);
+    bool createFile(const Session& session, const std::string& filename);
+    bool createDirectory(const Session& session, const std::string& dirname);
+    bool removeFile(const Session& session, const std::string& filename);
+    bool removeDirectory(const Session& session, const std::string& dirname);
     
-    bool writeFile(const std::string& filename, const std::string& content);
-    std::string readFile(const std::string& filename);
+    bool writeFile(const Session& session, const std::string& filename, const std::string& content);
+    std::string readFile(const Session& session, const std::string& filename);
+    // 按偏移读写（pread/pwrite 语义）：返回实际读写的字节数，出错返回 -1。
+    // 只访问涉及的块，写入超出文件末尾时原地扩展文件
+    int64_t readFileAt(const Session& session, const std::string& filename, uint64_t offset,
+                       char* buffer, uint32_t length);
+    int64_t writeFileAt(const Session& session, const std::string& filename, uint64_t offset,
+                        const char* buffer, uint32_t length);
+    bool truncateFile(const Session& session, const std::string& filename, uint64_t size);
     // 写锁控制（供 Shell 在交互式写入前先获取/释放写锁）
-    bool lockFileForWrite(const std::string& filename);
-    void unlockFileForWrite(const std::string& filename);
-    bool writeFileLocked(const std::string& filename, const std::string& content);
+    bool lockFileForWrite(const Session& session, const std::string& filename);
+    void unlockFileForWrite(const Session& session, const std::string& filename);
+    bool writeFileLocked(const Session& session, const std::string& filename,
+                         const std::string& content);
+    // 追加写：只补齐尾块并分配新块，不改动已有数据
+    bool appendFile(const Session& session, const std::string& filename, const std::string& content);
+    bool appendFileLocked(const Session& session, const std::string& filename,
+                          const std::string& content);
     
-    // 跨进程写锁（基于磁盘状态）
+    // 跨进程写锁（Inode 范围上的独占 OFD 锁），须在持有进程内写锁时调用
     bool beginWrite(uint32_t inode_id);
     void endWrite(uint32_t inode_id);
     
     // 目录操作
-    bool changeDirectory(const std::string& path);
-    std::vector<std::pair<std::string, Inode>> listDirectory(const std::string& path = ".");
-    std::string getCurrentPath() const { return current_path; }
+    bool changeDirectory(Session& session, const std::string& path);
+    std::vector<std::pair<std::string, Inode>> listDirectory(const Session& session,
+                                                             const std::string& path = ".");
+    // readdirplus：目录项连同 Inode 分批流式返回，callback 返回 false 时提前结束。
+    // 每批按 Inode 编号顺序读取 Inode（同一 Inode 表块只访问一次），按目录顺序交给调用者
+    typedef std::function<bool(const std::vector<DirEntryPlus>&)> DirBatchCallback;
+    bool readDirectoryPlus(const Session& session, const std::string& path,
+                           const DirBatchCallback& callback,
+                           uint32_t batch_size = READDIR_BATCH_SIZE);
     
     // 权限管理
-    bool changePermission(const std::string& filename, uint16_t new_perm);
-    bool changeOwner(const std::string& filename, uint16_t new_owner);
+    bool changePermission(const Session& session, const std::string& filename, uint16_t new_perm);
+    bool changeOwner(const Session& session, const std::string& filename, uint16_t new_owner);
     
     // 辅助函数
     std::string getFileInfo(const Inode& inode);
     std::string permissionToString(uint16_t perm);
+    BlockCacheStats getCacheStats() const;
+    uint64_t getDentryHits() const;     // 目录项缓存命中次数（含负缓存）
+    uint64_t getDentryMisses() const;
+    const SuperBlock& getSuperBlock() const { return super_block; }
+    const char* getIOEngineName() const { return disk->ioEngineName(); }
+
+    // 提交控制：间隔为 N 时每 N 次操作刷盘一次（默认 1，即每次操作；仅 sync 模式）
+    void setCommitInterval(uint32_t operations);
+    // 持久性模式，下次挂载时生效；interval_ms 为 periodic 模式的刷盘周期
+    void setDurability(DurabilityMode mode, uint32_t interval_ms = DEFAULT_FLUSH_INTERVAL_MS);
+    DurabilityMode getDurability() const { return durability; }
+    uint32_t getDelayedBlocks() const { return delayed_blocks; }  // 尾部缓冲中尚未分配的块数
+    // 跨进程锁等待超时（毫秒）：小于 0 一直等待，0 不等待
+    void setLockTimeout(int timeout_ms) { lock_timeout_ms = timeout_ms; }
+    bool sync();                       // 立即提交所有修改并清空日志
 };
 
 #endif // FILESYSTEM_H
@@ -0,0 +1,140 @@
+#include "inodecache.h"
+#include "blockcache.h"
+#include "journal.h"
+#include <algorithm>
+#include <cstring>
+
+// ============= InodeCache 实现 =============
+
+InodeCache::InodeCache(BlockCache* cache, Journal* journal)
+    : cache(cache), journal(journal), table_block(0), inode_count(0), loaded(false) {}
+
+InodeCache::~InodeCache() {
+    release();
+}
+
+void InodeCache::release() {
+    for (char* block : blocks) {
+        freeBlockBuffer(block);
+    }
+    blocks.clear();
+    dirty.clear();
+    dirty_blocks.clear();
+}
+
+bool InodeCache::load(uint32_t table_block, uint32_t inode_count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    release();
+    this->table_block = table_block;
+    this->inode_count = inode_count;
+    uint32_t count = static_cast<uint32_t>((static_cast<uint64_t>(inode_count) * INODE_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    blocks.assign(count, nullptr);
+    dirty.assign(inode_count, 0);
+    loaded = true;
+    return true;
+}
+
+Inode* InodeCache::slot(uint32_t inode_id) {
+    uint32_t block = blockOf(inode_id);
+    if (!blocks[block]) {
+        char* buffer = allocateBlockBuffer(1);
+        if (!buffer) {
+            return nullptr;
+        }
+        if (!cache->readBlock(table_block + block, buffer)) {
+            freeBlockBuffer(buffer);
+            return nullptr;
+        }
+        blocks[block] = buffer;
+    }
+    return reinterpret_cast<Inode*>(blocks[block] + offsetOf(inode_id));
+}
+
+bool InodeCache::read(uint32_t inode_id, Inode& inode) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!loaded || inode_id >= inode_count) {
+        return false;
+    }
+    Inode* entry = slot(inode_id);
+    if (!entry) {
+        return false;
+    }
+    memcpy(&inode, entry, sizeof(Inode));
+    return true;
+}
+
+bool InodeCache::write(uint32_t inode_id, const Inode& inode) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!loaded || inode_id >= inode_count) {
+        return false;
+    }
+    Inode* entry = slot(inode_id);
+    if (!entry) {
+        return false;
+    }
+    memcpy(entry, &inode, sizeof(Inode));
+    dirty[inode_id] = 1;
+    dirty_blocks.insert(blockOf(inode_id));
+    return true;
+}
+
+bool InodeCache::refresh(uint32_t inode_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!loaded || inode_id >= inode_count) {
+        return false;
+    }
+    if (dirty[inode_id]) {
+        return true;
+    }
+
+    uint32_t block_num = table_block + blockOf(inode_id);
+    if (!cache->refreshBlock(block_num)) {
+        return false;
+    }
+    Inode* entry = slot(inode_id);
+    const char* block = cache->pinBlock(block_num);
+    if (!entry || !block) {
+        if (block) {
+            cache->unpinBlock(block_num, false);
+        }
+        return false;
+    }
+    memcpy(entry, block + offsetOf(inode_id), sizeof(Inode));
+    cache->unpinBlock(block_num, false);
+    return true;
+}
+
+bool InodeCache::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dirty_blocks.empty()) {
+        return true;
+    }
+
+    // 含有脏 Inode 的块按块号顺序整块写入块缓存
+    std::vector<uint32_t> block_nums;
+    std::vector<const char*> buffers;
+    for (uint32_t block : dirty_blocks) {
+        block_nums.push_back(table_block + block);
+        buffers.push_back(blocks[block]);
+    }
+    for (uint32_t block_num : block_nums) {
+        journal->addBlock(block_num, false);
+    }
+    if (!cache->writeBlocks(block_nums.data(), buffers.data(), block_nums.size())) {
+        return false;
+    }
+
+    const uint32_t per_block = BLOCK_SIZE / INODE_SIZE;
+    for (uint32_t block : dirty_blocks) {
+        uint32_t first = block * per_block;
+        uint32_t end = std::min(inode_count, first + per_block);
+        std::fill(dirty.begin() + first, dirty.begin() + end, 0);
+    }
+    dirty_blocks.clear();
+    return true;
+}
+
+uint32_t InodeCache::getDirtyCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<uint32_t>(std::count(dirty.begin(), dirty.end(), 1));
+}
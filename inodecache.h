@@ -0,0 +1,61 @@
+#ifndef INODECACHE_H
+#define INODECACHE_H
+
+#include "filesystem.h"
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <vector>
+
+class BlockCache;
+class Journal;
+
+// ============= Inode 缓存 =============
+// Inode 表按块缓存在内存中：某块中的 Inode 第一次被访问时才整块读入，
+// 之后该块中 Inode 的读写都在内存副本上进行，Inode 表很大时挂载也无需读入整张表。
+// 内存中每块的布局与磁盘上的 Inode 表完全一致，写回时以整块为单位：
+// 同一块中的脏 Inode 合并为一次块写入，块号连续的脏块再合并为一次批量写。
+// 写回的表块先加入日志的当前事务，提交前不会写回原位。
+// 各操作由一把互斥锁保护，读写单个 Inode 都是整体拷贝，不会读到写了一半的 Inode。
+class InodeCache {
+private:
+    BlockCache* cache;
+    Journal* journal;
+    uint32_t table_block;           // Inode 表起始块
+    uint32_t inode_count;
+    bool loaded;
+    std::vector<char*> blocks;      // 已读入的表块（未读入为 nullptr）
+    std::vector<uint8_t> dirty;     // 每个 Inode 的脏标记
+    std::set<uint32_t> dirty_blocks;  // 含有脏 Inode 的表块（表内序号）
+    mutable std::mutex mutex;
+
+    void release();
+    // 字节偏移按 64 位计算，Inode 编号很大时不会回绕到前面的槽位
+    uint32_t blockOf(uint32_t inode_id) const {
+        return static_cast<uint32_t>(static_cast<uint64_t>(inode_id) * INODE_SIZE / BLOCK_SIZE);
+    }
+    uint32_t offsetOf(uint32_t inode_id) const {
+        return static_cast<uint32_t>(static_cast<uint64_t>(inode_id) * INODE_SIZE % BLOCK_SIZE);
+    }
+    // 返回 Inode 在内存中的位置，所在块未读入时先从块缓存读入（需持有 mutex）
+    Inode* slot(uint32_t inode_id);
+
+public:
+    InodeCache(BlockCache* cache, Journal* journal);
+    ~InodeCache();
+
+    // 挂载/格式化：设置 Inode 表的位置和大小，丢弃已缓存的表块，之后按需读入
+    bool load(uint32_t table_block, uint32_t inode_count);
+    bool isLoaded() const { return loaded; }
+
+    bool read(uint32_t inode_id, Inode& inode);
+    bool write(uint32_t inode_id, const Inode& inode);
+
+    // 从块缓存重新读取一个 Inode（跨进程状态）；脏时保留内存副本
+    bool refresh(uint32_t inode_id);
+
+    bool flush();                   // 把脏 Inode 所在的整块写入块缓存
+    uint32_t getDirtyCount() const;
+};
+
+#endif // INODECACHE_H
@@ -0,0 +1,438 @@
+#include "journal.h"
+#include "blockcache.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+// ============= Journal 实现 =============
+
+Journal::Journal(VirtualDisk* disk, BlockCache* cache)
+    : disk(disk), cache(cache), start(0), length(0), updates_locked(false), updates(0),
+      running_tid(1), committed_tid(0) {}
+
+// 按 32 位字计算的 FNV-1a 校验和
+static uint32_t recordChecksum(const char* data, size_t bytes) {
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(data);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < bytes / sizeof(uint32_t); i++) {
+        hash ^= words[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void Journal::resetState() {
+    // 只在格式化/挂载时调用：此前块缓存已被清空，事务中的 pin 随之失效
+    std::lock_guard<std::mutex> lock(mutex);
+    running_blocks.clear();
+    running_revokes.clear();
+    committing.clear();
+    writing_home.clear();
+    logged.clear();
+    committed_tid = running_tid - 1;
+}
+
+bool Journal::readHeader(JournalHeader& header) {
+    char* buffer = allocateBlockBuffer(1);
+    if (!buffer) {
+        return false;
+    }
+    bool ok = disk->readBlock(start, buffer);
+    memcpy(&header, buffer, sizeof(header));
+    freeBlockBuffer(buffer);
+    return ok && header.magic == JOURNAL_MAGIC;
+}
+
+bool Journal::writeHeader(const JournalHeader& header) {
+    char* buffer = allocateBlockBuffer(1);
+    if (!buffer) {
+        return false;
+    }
+    memset(buffer, 0, BLOCK_SIZE);
+    memcpy(buffer, &header, sizeof(header));
+    uint32_t block_num = start;
+    bool ok = cache->writeBlocks(&block_num, &buffer, 1);
+    freeBlockBuffer(buffer);
+    return ok;
+}
+
+bool Journal::format(uint32_t start, uint32_t length) {
+    this->start = 0;
+    this->length = 0;
+    resetState();
+    if (start == 0 || length < 2) {
+        return true;
+    }
+    this->start = start;
+    this->length = length;
+
+    JournalHeader header;
+    header.magic = JOURNAL_MAGIC;
+    header.head = 1;
+    header.first_sequence = 1;
+    header.next_sequence = 1;
+    return writeHeader(header);
+}
+
+bool Journal::recover(uint32_t start, uint32_t length, uint32_t& replayed) {
+    replayed = 0;
+    this->start = 0;
+    this->length = 0;
+    resetState();
+    if (start == 0 || length < 2) {
+        return true;  // 没有日志区的旧镜像：元数据直接写回原位
+    }
+    this->start = start;
+    this->length = length;
+
+    uint64_t lock_offset = static_cast<uint64_t>(start) * BLOCK_SIZE;
+    int handle = disk->lockRange(lock_offset, BLOCK_SIZE, true, -1);
+    if (handle < 0) {
+        return false;
+    }
+    JournalHeader header;
+    if (!readHeader(header)) {
+        disk->unlockRange(handle, lock_offset, BLOCK_SIZE);
+        return false;
+    }
+
+    // 第一遍：从第 1 块起按序号读取完整且校验和正确的记录，并收集撤销项
+    struct Record {
+        uint64_t sequence;
+        char* data;
+    };
+    std::vector<Record> records;
+    std::map<uint32_t, uint64_t> revoked;  // 块号 -> 最后一次撤销所在的序号
+    uint32_t pos = 1;
+    uint64_t sequence = header.first_sequence;
+    while (pos < length) {
+        char* descriptor = allocateBlockBuffer(1);
+        if (!descriptor || !disk->readBlock(start + pos, descriptor)) {
+            freeBlockBuffer(descriptor);
+            break;
+        }
+        JournalRecord* record = reinterpret_cast<JournalRecord*>(descriptor);
+        uint32_t count = record->count;
+        bool valid = record->magic == JOURNAL_RECORD_MAGIC && record->sequence == sequence &&
+                     count + record->revoke_count <= JOURNAL_RECORD_CAPACITY &&
+                     pos + 1 + count <= length;
+        char* data = valid ? allocateBlockBuffer(1 + count) : nullptr;
+        if (data) {
+            memcpy(data, descriptor, BLOCK_SIZE);
+            std::vector<char*> buffers(count);
+            for (uint32_t i = 0; i < count; i++) {
+                buffers[i] = data + static_cast<size_t>(i + 1) * BLOCK_SIZE;
+            }
+            valid = count == 0 || disk->readBlocks(start + pos + 1, count, buffers.data());
+        }
+        freeBlockBuffer(descriptor);
+        if (valid && data) {
+            record = reinterpret_cast<JournalRecord*>(data);
+            uint32_t checksum = record->checksum;
+            record->checksum = 0;
+            valid = recordChecksum(data, static_cast<size_t>(1 + count) * BLOCK_SIZE) == checksum;
+        }
+        if (!valid || !data) {
+            freeBlockBuffer(data);
+            break;
+        }
+        for (uint32_t i = 0; i < record->revoke_count; i++) {
+            revoked[record->blocks[count + i]] = sequence;
+        }
+        records.push_back(Record{sequence, data});
+        pos += 1 + count;
+        sequence++;
+    }
+
+    // 第二遍：按顺序把映像写回原位，跳过之后被撤销（块已释放、可能已另作他用）的块
+    bool ok = true;
+    for (const Record& entry : records) {
+        const JournalRecord* record = reinterpret_cast<const JournalRecord*>(entry.data);
+        for (uint32_t i = 0; i < record->count; i++) {
+            uint32_t block_num = record->blocks[i];
+            auto it = revoked.find(block_num);
+            if (it != revoked.end() && it->second >= entry.sequence) {
+                continue;
+            }
+            if (!disk->writeBlock(block_num, entry.data + static_cast<size_t>(i + 1) * BLOCK_SIZE)) {
+                ok = false;
+            }
+        }
+        freeBlockBuffer(entry.data);
+    }
+    replayed = static_cast<uint32_t>(records.size());
+
+    // 重放结果刷盘后清空日志
+    if (ok) {
+        header.head = 1;
+        header.first_sequence = sequence;
+        header.next_sequence = sequence;
+        ok = disk->flush() && writeHeader(header) && disk->flush();
+    }
+    disk->unlockRange(handle, lock_offset, BLOCK_SIZE);
+    return ok;
+}
+
+void Journal::beginUpdate() {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::thread::id self = std::this_thread::get_id();
+    if (updaters.count(self)) {
+        return;
+    }
+    cv.wait(lock, [this] { return !updates_locked; });
+    updaters.insert(self);
+    updates++;
+}
+
+uint64_t Journal::endUpdate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (updaters.erase(std::this_thread::get_id()) && --updates == 0) {
+        cv.notify_all();
+    }
+    return running_tid;
+}
+
+void Journal::addBlock(uint32_t block_num, bool load) {
+    if (start == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running_blocks.insert(block_num).second) {
+        return;
+    }
+    running_revokes.erase(block_num);
+    // pin 住直到事务提交：块缓存不会在提交前把修改写回原位
+    if (!cache->pinBlock(block_num, load)) {
+        running_blocks.erase(block_num);
+    }
+}
+
+void Journal::revokeBlock(uint32_t block_num) {
+    if (start == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    if (running_blocks.erase(block_num)) {
+        cache->unpinBlock(block_num, false);
+    }
+    // 正在提交的事务不再把该块写回原位；已在写回时等它完成，之后块才能另作他用
+    committing.erase(block_num);
+    cv.wait(lock, [this, block_num] { return writing_home.count(block_num) == 0; });
+    if (logged.count(block_num)) {
+        running_revokes.insert(block_num);
+    }
+}
+
+bool Journal::isCommitted(uint64_t tid) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return committed_tid >= tid;
+}
+
+bool Journal::isFull() {
+    std::lock_guard<std::mutex> lock(mutex);
+    // 日志区按磁盘大小伸缩，但一个事务还要装进一个描述块、不能 pin 住整个块缓存
+    uint32_t limit = std::min(std::min(length, JOURNAL_RECORD_CAPACITY), cache->getCapacity()) / 2;
+    return start != 0 && running_blocks.size() + running_revokes.size() + 1 >= limit;
+}
+
+void Journal::lockUpdates() {
+    std::unique_lock<std::mutex> lock(mutex);
+    updates_locked = true;
+    cv.wait(lock, [this] { return updates == 0; });
+}
+
+bool Journal::commit() {
+    // 关闭当前事务：复制块映像（此时没有进行中的修改），随后立即放行新的操作
+    uint64_t tid;
+    std::vector<uint32_t> blocks;
+    std::vector<uint32_t> revokes;
+    char* record = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tid = running_tid++;
+        revokes.assign(running_revokes.begin(), running_revokes.end());
+        running_revokes.clear();
+        if (!running_blocks.empty() || !revokes.empty()) {
+            record = allocateBlockBuffer(static_cast<uint32_t>(1 + running_blocks.size()));
+        }
+        if (record) {
+            memset(record, 0, BLOCK_SIZE);
+            for (uint32_t block_num : running_blocks) {
+                char* image = record + (1 + blocks.size()) * BLOCK_SIZE;
+                if (cache->snapshotBlock(block_num, image)) {
+                    blocks.push_back(block_num);
+                    committing.insert(block_num);
+                    logged.insert(block_num);
+                } else {
+                    cache->unpinBlock(block_num, true);
+                }
+            }
+        } else {
+            for (uint32_t block_num : running_blocks) {
+                cache->unpinBlock(block_num, true);
+            }
+        }
+        running_blocks.clear();
+        updates_locked = false;
+        cv.notify_all();
+    }
+
+    uint32_t count = static_cast<uint32_t>(blocks.size());
+    bool ok;
+    if (!record) {
+        ok = cache->flush();
+    } else {
+        JournalRecord* descriptor = reinterpret_cast<JournalRecord*>(record);
+        descriptor->magic = JOURNAL_RECORD_MAGIC;
+        descriptor->count = count;
+        descriptor->revoke_count = static_cast<uint32_t>(revokes.size());
+        if (count + revokes.size() <= JOURNAL_RECORD_CAPACITY && 1 + count < length) {
+            std::copy(blocks.begin(), blocks.end(), descriptor->blocks);
+            std::copy(revokes.begin(), revokes.end(), descriptor->blocks + count);
+            ok = writeRecord(record, 1 + count);
+        } else {
+            // 事务超出日志容量：不经日志直接写回原位，随后清空日志使撤销不再需要
+            ok = cache->flush() && writeHome(blocks, record + BLOCK_SIZE) && checkpoint();
+        }
+    }
+
+    // 写入失败时把块重新标脏，交给块缓存之后写回
+    for (uint32_t block_num : blocks) {
+        cache->unpinBlock(block_num, !ok);
+    }
+    freeBlockBuffer(record);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t block_num : blocks) {
+        committing.erase(block_num);
+    }
+    if (ok) {
+        committed_tid = tid;
+    }
+    return ok;
+}
+
+bool Journal::writeRecord(char* record, uint32_t count) {
+    // 持日志头块上的锁完成追加、刷盘和写回原位，其他进程的提交依次进行
+    uint64_t lock_offset = static_cast<uint64_t>(start) * BLOCK_SIZE;
+    int handle = disk->lockRange(lock_offset, BLOCK_SIZE, true, -1);
+    if (handle < 0) {
+        return false;
+    }
+    JournalHeader header;
+    bool ok = readHeader(header);
+
+    // 剩余空间不足：此前各事务都已写回原位，刷盘后日志从头开始
+    bool recycled = false;
+    if (ok && header.head + count > length) {
+        ok = disk->flush();
+        header.head = 1;
+        header.first_sequence = header.next_sequence;
+        recycled = true;
+    }
+
+    if (ok) {
+        JournalRecord* descriptor = reinterpret_cast<JournalRecord*>(record);
+        descriptor->sequence = header.next_sequence;
+        descriptor->checksum = 0;
+        descriptor->checksum = recordChecksum(record, static_cast<size_t>(count) * BLOCK_SIZE);
+
+        std::vector<uint32_t> positions(count);
+        std::vector<const char*> buffers(count);
+        for (uint32_t i = 0; i < count; i++) {
+            positions[i] = start + header.head + i;
+            buffers[i] = record + static_cast<size_t>(i) * BLOCK_SIZE;
+        }
+        header.head += count;
+        header.next_sequence++;
+
+        // 记录是一次顺序写；数据块随后写回，二者共用 flush 中的一次 fdatasync
+        ok = cache->writeBlocks(positions.data(), buffers.data(), count) &&
+             writeHeader(header) && cache->flush();
+    }
+    if (ok && recycled) {
+        // 旧记录已不会被重放，其中的块释放时无需撤销
+        std::lock_guard<std::mutex> lock(mutex);
+        logged.clear();
+        const JournalRecord* descriptor = reinterpret_cast<const JournalRecord*>(record);
+        logged.insert(descriptor->blocks, descriptor->blocks + descriptor->count);
+    }
+    if (ok) {
+        const JournalRecord* descriptor = reinterpret_cast<const JournalRecord*>(record);
+        std::vector<uint32_t> blocks(descriptor->blocks, descriptor->blocks + descriptor->count);
+        ok = writeHome(blocks, record + BLOCK_SIZE);
+    }
+    disk->unlockRange(handle, lock_offset, BLOCK_SIZE);
+    return ok;
+}
+
+bool Journal::writeHome(const std::vector<uint32_t>& blocks, const char* images) {
+    // 映射型后端的块缓存就是映射区本身，修改已在原位
+    if (disk->isMapped()) {
+        return true;
+    }
+
+    std::vector<size_t> selected;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if (committing.erase(blocks[i])) {
+                writing_home.insert(blocks[i]);
+                selected.push_back(i);
+            }
+        }
+    }
+
+    // 块号连续的映像合并为一次向量写
+    bool ok = true;
+    std::vector<const char*> buffers;
+    size_t i = 0;
+    while (i < selected.size()) {
+        size_t j = i + 1;
+        while (j < selected.size() && blocks[selected[j]] == blocks[selected[j - 1]] + 1) {
+            j++;
+        }
+        buffers.clear();
+        for (size_t k = i; k < j; k++) {
+            buffers.push_back(images + selected[k] * BLOCK_SIZE);
+        }
+        if (!disk->writeBlocks(blocks[selected[i]], static_cast<uint32_t>(j - i), buffers.data())) {
+            ok = false;
+        }
+        i = j;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t index : selected) {
+        writing_home.erase(blocks[index]);
+    }
+    cv.notify_all();
+    return ok;
+}
+
+bool Journal::checkpoint() {
+    if (start == 0) {
+        return true;
+    }
+    uint64_t lock_offset = static_cast<uint64_t>(start) * BLOCK_SIZE;
+    int handle = disk->lockRange(lock_offset, BLOCK_SIZE, true, -1);
+    if (handle < 0) {
+        return false;
+    }
+
+    // 已提交的事务都已写回原位：刷盘后它们不再需要重放
+    JournalHeader header;
+    bool ok = readHeader(header) && disk->flush();
+    if (ok && header.head != 1) {
+        header.head = 1;
+        header.first_sequence = header.next_sequence;
+        ok = writeHeader(header) && disk->flush();
+    }
+    disk->unlockRange(handle, lock_offset, BLOCK_SIZE);
+
+    if (ok) {
+        std::lock_guard<std::mutex> lock(mutex);
+        logged.clear();
+    }
+    return ok;
+}
@@ -0,0 +1,108 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "virtualdisk.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+class BlockCache;
+
+// ============= 日志常量 =============
+const uint32_t JOURNAL_MAGIC = 0x4c4e524a;        // "JRNL"，日志区头块
+const uint32_t JOURNAL_RECORD_MAGIC = 0x43534544; // "DESC"，事务描述块
+
+// ============= 日志磁盘格式 =============
+// 日志区第 0 块为头块，之后顺序存放事务记录：
+//   [描述块] [块映像 0] [块映像 1] ...
+// 描述块列出各映像的原位置，以及本事务中被释放、不应再重放旧映像的块（撤销项）。
+// 记录不跨越日志区末尾；空间不足时先把已提交的事务全部刷盘，再从第 1 块重新开始。
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t head;                 // 下一条记录的写入位置（日志区内的块号）
+    uint64_t first_sequence;       // 第 1 块处记录的序号：重放从这里开始
+    uint64_t next_sequence;        // 下一条记录的序号
+};
+
+const uint32_t JOURNAL_RECORD_CAPACITY = (BLOCK_SIZE - 24) / sizeof(uint32_t);
+
+struct JournalRecord {
+    uint32_t magic;
+    uint32_t count;                // 块映像数
+    uint64_t sequence;
+    uint32_t revoke_count;         // 撤销项数
+    uint32_t checksum;             // 描述块（本字段置 0）与全部块映像的校验和
+    uint32_t blocks[JOURNAL_RECORD_CAPACITY];  // 先是 count 个映像的原位置，再是撤销项
+};
+
+static_assert(sizeof(JournalRecord) == BLOCK_SIZE, "描述块必须正好占用一个块");
+
+// ============= 元数据日志（预写式，组提交）=============
+// 元数据块（超级块、位图、Inode 表、目录块、extent 块）在修改前由 addBlock 加入
+// 当前事务并被 pin 在块缓存中，提交前不会写回原位。
+// 每个修改操作以 beginUpdate/endUpdate 包围；提交时 lockUpdates 等待进行中的操作结束，
+// 复制块映像后立即放行新操作，再把整个事务作为一条记录顺序写入日志区，
+// 与数据块一起只做一次 fdatasync，然后把映像写回原位（不再单独刷盘）。
+// 提交期间到达的操作进入下一个事务，由下一次提交一并写入（组提交）。
+// 挂载时按序号重放日志中校验和正确的记录。
+// 日志头块上的 OFD 锁使共享同一镜像的多个进程依次追加记录。
+class Journal {
+private:
+    VirtualDisk* disk;
+    BlockCache* cache;
+    uint32_t start;                    // 日志区起始块（为 0 时不记日志）
+    uint32_t length;                   // 日志区块数
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool updates_locked;               // 正在复制块映像，新操作等待
+    uint32_t updates;                  // 进行中的修改操作数
+    std::set<std::thread::id> updaters;  // 持有修改句柄的线程
+    uint64_t running_tid;              // 当前接收修改的事务
+    uint64_t committed_tid;            // 最后一个已提交（已刷盘）的事务
+    std::set<uint32_t> running_blocks;   // 当前事务的元数据块（已 pin）
+    std::set<uint32_t> running_revokes;  // 当前事务中释放的、日志里有旧映像的块
+    std::set<uint32_t> committing;       // 正在提交、尚待写回原位的块
+    std::set<uint32_t> writing_home;     // 正在写回原位的块
+    std::unordered_set<uint32_t> logged; // 日志区中有映像的块（释放时需要撤销）
+
+    bool readHeader(JournalHeader& header);
+    bool writeHeader(const JournalHeader& header);
+    // 把记录写入日志区（空间不足时先回收），与数据块一起刷盘
+    bool writeRecord(char* record, uint32_t count);
+    // 把提交后的块映像写回原位，跳过提交期间被释放的块
+    bool writeHome(const std::vector<uint32_t>& blocks, const char* images);
+    void resetState();
+
+public:
+    Journal(VirtualDisk* disk, BlockCache* cache);
+
+    bool format(uint32_t start, uint32_t length);  // 格式化：写入空日志头
+    // 挂载：重放日志中已提交的事务并清空日志，replayed 返回重放的事务数。
+    // length 为 0（无日志区的旧镜像）时不记日志
+    bool recover(uint32_t start, uint32_t length, uint32_t& replayed);
+    bool isEnabled() const { return start != 0; }
+
+    // 修改操作的边界：begin 在修改前（已持有文件/目录锁后）调用，
+    // end 返回修改所属的事务编号；同一线程重复 begin 不会嵌套
+    void beginUpdate();
+    uint64_t endUpdate();
+
+    void addBlock(uint32_t block_num, bool load = true);  // 修改元数据块之前调用
+    void revokeBlock(uint32_t block_num);                 // 块被释放时调用
+
+    bool isCommitted(uint64_t tid);
+    bool isFull();                     // 当前事务已接近日志容量，应尽快提交
+
+    // 提交（调用者持有提交锁）：lockUpdates 之后把内存中的元数据写入块缓存，
+    // 再调用 commit 写日志、刷盘并写回原位
+    void lockUpdates();
+    bool commit();
+    bool checkpoint();                 // 刷盘后清空日志（sync、卸载时调用）
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,75 @@
+#include "locktable.h"
+
+// ============= LockTable 实现 =============
+
+LockTable::LockTable(uint32_t capacity) : capacity(capacity) {}
+
+void LockTable::release(Shard& shard, std::unordered_map<uint32_t, Entry>::iterator it) {
+    if (it->second.waiters > 0) {
+        shard.cv.notify_all();
+    } else if (it->second.idle()) {
+        shard.entries.erase(it);
+    }
+}
+
+void LockTable::lockShared(uint32_t inode_id) {
+    if (inode_id >= capacity) {
+        return;
+    }
+
+    // 没有写者时直接增加读者数，否则登记为等待者直到写者离开
+    Shard& shard = shardOf(inode_id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    Entry& entry = shard.entries[inode_id];  // 哈希表的元素引用在插入其他项后仍然有效
+    if (entry.writer) {
+        entry.waiters++;
+        shard.cv.wait(lock, [&entry] { return !entry.writer; });
+        entry.waiters--;
+    }
+    entry.readers++;
+}
+
+void LockTable::unlockShared(uint32_t inode_id) {
+    if (inode_id >= capacity) {
+        return;
+    }
+    Shard& shard = shardOf(inode_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(inode_id);
+    if (it == shard.entries.end() || it->second.readers == 0) {
+        return;
+    }
+    it->second.readers--;
+    release(shard, it);
+}
+
+void LockTable::lockExclusive(uint32_t inode_id) {
+    if (inode_id >= capacity) {
+        return;
+    }
+
+    // 没有读者和写者时直接置写者标记，否则登记为等待者
+    Shard& shard = shardOf(inode_id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    Entry& entry = shard.entries[inode_id];
+    if (entry.writer || entry.readers > 0) {
+        entry.waiters++;
+        shard.cv.wait(lock, [&entry] { return !entry.writer && entry.readers == 0; });
+        entry.waiters--;
+    }
+    entry.writer = true;
+}
+
+void LockTable::unlockExclusive(uint32_t inode_id) {
+    if (inode_id >= capacity) {
+        return;
+    }
+    Shard& shard = shardOf(inode_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(inode_id);
+    if (it == shard.entries.end() || !it->second.writer) {
+        return;
+    }
+    it->second.writer = false;
+    release(shard, it);
+}
@@ -0,0 +1,51 @@
+#ifndef LOCKTABLE_H
+#define LOCKTABLE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// ============= 锁表常量 =============
+const uint32_t LOCK_TABLE_SHARDS = 64;             // 锁表分片数
+
+// ============= 进程内文件读写锁表 =============
+// 按 Inode 编号分片，每个分片一把互斥锁、一个条件变量和一张哈希表。
+// 表项在第一次加锁时创建，记录读者数、写者标记和等待者数量；
+// 最后一个持有者或等待者离开时删除，表的大小只与当前正在使用的文件有关，
+// 与镜像中的 Inode 总数无关。
+// 不同分片上的加解锁互不串行，只有落在同一分片上的文件才共用一把互斥锁。
+class LockTable {
+private:
+    struct Entry {
+        uint32_t readers;
+        bool writer;
+        uint32_t waiters;
+
+        Entry() : readers(0), writer(false), waiters(0) {}
+        bool idle() const { return readers == 0 && !writer && waiters == 0; }
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::unordered_map<uint32_t, Entry> entries;  // Inode -> 锁状态（只含使用中的）
+    };
+
+    uint32_t capacity;
+    Shard shards[LOCK_TABLE_SHARDS];
+
+    Shard& shardOf(uint32_t inode_id) { return shards[inode_id % LOCK_TABLE_SHARDS]; }
+    // 释放后检查表项：有等待者时唤醒，空闲时删除（需持有分片锁）
+    void release(Shard& shard, std::unordered_map<uint32_t, Entry>::iterator it);
+
+public:
+    explicit LockTable(uint32_t capacity);
+
+    void lockShared(uint32_t inode_id);
+    void unlockShared(uint32_t inode_id);
+    void lockExclusive(uint32_t inode_id);
+    void unlockExclusive(uint32_t inode_id);
+};
+
+#endif // LOCKTABLE_H
@@ -1,13 +1,75 @@
 #include "filesystem.h"
 #include "shell.h"
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
 
-int main(int /* argc */, char* /* argv */[]) {
+static void printUsage(const char* prog) {
+    std::cout << "用法: " << prog << " [--backend=fstream|mmap|pread] [--direct]"
+              << " [--commit-interval=N] [--durability=sync|periodic|none] [--flush-interval=MS]"
+              << " [--lock-timeout=MS] [磁盘文件]" << std::endl;
+    std::cout << "  --direct             pread 后端使用 O_DIRECT 绕过宿主页缓存" << std::endl;
+    std::cout << "  --commit-interval=N  每 N 次修改操作刷盘一次（默认 1）" << std::endl;
+    std::cout << "  --durability=MODE    sync 每次操作刷盘（默认）；periodic 后台定时刷盘；"
+              << "none 不等待落盘（仅适合临时镜像）" << std::endl;
+    std::cout << "  --flush-interval=MS  periodic 模式的刷盘周期（默认 "
+              << DEFAULT_FLUSH_INTERVAL_MS << "）" << std::endl;
+    std::cout << "  --lock-timeout=MS    等待其他进程释放文件锁的毫秒数（默认 "
+              << DEFAULT_LOCK_TIMEOUT_MS << "，-1 表示一直等待）" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string disk_file = "disk.bin";
+    DiskBackend backend = DISK_BACKEND_FSTREAM;
+    bool direct_io = false;
+    uint32_t commit_interval = 1;
+    DurabilityMode durability = DURABILITY_SYNC;
+    uint32_t flush_interval_ms = DEFAULT_FLUSH_INTERVAL_MS;
+    int lock_timeout_ms = DEFAULT_LOCK_TIMEOUT_MS;
+    
+    // 解析命令行参数
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--backend=fstream") {
+            backend = DISK_BACKEND_FSTREAM;
+        } else if (arg == "--backend=mmap") {
+            backend = DISK_BACKEND_MMAP;
+        } else if (arg == "--backend=pread") {
+            backend = DISK_BACKEND_PREAD;
+        } else if (arg == "--direct") {
+            direct_io = true;
+        } else if (arg.compare(0, 18, "--commit-interval=") == 0) {
+            commit_interval = static_cast<uint32_t>(strtoul(arg.c_str() + 18, nullptr, 10));
+        } else if (arg == "--durability=sync") {
+            durability = DURABILITY_SYNC;
+        } else if (arg == "--durability=periodic") {
+            durability = DURABILITY_PERIODIC;
+        } else if (arg == "--durability=none") {
+            durability = DURABILITY_NONE;
+        } else if (arg.compare(0, 17, "--flush-interval=") == 0) {
+            flush_interval_ms = static_cast<uint32_t>(strtoul(arg.c_str() + 17, nullptr, 10));
+        } else if (arg.compare(0, 15, "--lock-timeout=") == 0) {
+            lock_timeout_ms = static_cast<int>(strtol(arg.c_str() + 15, nullptr, 10));
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            std::cerr << "未知选项: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            disk_file = arg;
+        }
+    }
+    
     // 设置 UTF-8 输出（Linux 系统通常默认支持）
     std::cout << "初始化文件系统..." << std::endl;
     
     // 创建文件系统实例
-    FileSystem fs("disk.bin");
+    FileSystem fs(disk_file, backend, direct_io);
+    fs.setCommitInterval(commit_interval);
+    fs.setDurability(durability, flush_interval_ms);
+    fs.setLockTimeout(lock_timeout_ms);
     
     // 创建 Shell
     Shell shell(&fs);
@@ -17,4 +79,3 @@ int main(int /* argc */, char* /* argv */[]) {
     
     return 0;
 }
-
@@ -1,8 +1,10 @@
 #include "shell.h"
+#include "blockcache.h"
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <cstdlib>
 
 Shell::Shell(FileSystem* filesystem) : fs(filesystem), running(false) {
 }
@@ -23,9 +25,9 @@ std::vector<std::string> Shell::parseCommand(const std::string& input) {
 }
 
 void Shell::printPrompt() {
-    if (fs->getCurrentUser()) {
-        std::cout << fs->getCurrentUser()->username << "@myfs:" 
-                  << fs->getCurrentPath() << "$ ";
+    if (session.logged_in) {
+        std::cout << session.user.username << "@myfs:" 
+                  << session.cwd_path << "$ ";
     } else {
         std::cout << "login: ";
     }
@@ -73,9 +75,11 @@ bool Shell::processCommand(const std::string& input) {
     if (cmd == "help") {
         cmdHelp();
     } else if (cmd == "format") {
-        cmdFormat();
+        cmdFormat(tokens);
     } else if (cmd == "mount") {
         cmdMount();
+    } else if (cmd == "sync") {
+        cmdSync();
     } else if (cmd == "login") {
         cmdLogin();
     } else if (cmd == "logout") {
@@ -100,6 +104,8 @@ bool Shell::processCommand(const std::string& input) {
         cmdCat(tokens);
     } else if (cmd == "write") {
         cmdWrite(tokens);
+    } else if (cmd == "append") {
+        cmdAppend(tokens);
     } else if (cmd == "chmod") {
         cmdChmod(tokens);
     } else if (cmd == "chown") {
@@ -119,8 +125,9 @@ bool Shell::processCommand(const std::string& input) {
 void Shell::cmdHelp() {
     std::cout << "\n可用命令：\n" << std::endl;
     std::cout << "系统管理：" << std::endl;
-    std::cout << "  format              - 格式化文件系统" << std::endl;
+    std::cout << "  format [大小] [块大小] [Inode数] - 格式化文件系统" << std::endl;
     std::cout << "  mount               - 挂载文件系统" << std::endl;
+    std::cout << "  sync                - 立即把所有修改写回磁盘" << std::endl;
     std::cout << "  info                - 显示文件系统信息" << std::endl;
     std::cout << "  exit/quit           - 退出系统" << std::endl;
     std::cout << std::endl;
@@ -141,6 +148,7 @@ void Shell::cmdHelp() {
     std::cout << "  rmdir <name>        - 删除目录" << std::endl;
     std::cout << "  cat <file>          - 查看文件内容" << std::endl;
     std::cout << "  write <file>        - 写入文件（交互式）" << std::endl;
+    std::cout << "  append <file>       - 追加到文件末尾（交互式）" << std::endl;
     std::cout << std::endl;
     
     std::cout << "权限管理：" << std::endl;
@@ -151,10 +159,44 @@ void Shell::cmdHelp() {
     std::cout << "提示：" << std::endl;
     std::cout << "  - 默认用户: root/root, user1/123456, user2/123456" << std::endl;
     std::cout << "  - 权限格式: rwxrwxrwx (所有者/组/其他)" << std::endl;
+    std::cout << "  - format 的大小可带 K/M/G 后缀，省略的参数沿用镜像大小、4096 字节块、每 16KB 一个 Inode" << std::endl;
     std::cout << std::endl;
 }
 
-void Shell::cmdFormat() {
+bool Shell::parseSize(const std::string& text, uint64_t& size) {
+    // 十进制数字，可带 K/M/G 后缀（1024 进制）
+    char* end = nullptr;
+    size = strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) {
+        return false;
+    }
+    std::string suffix(end);
+    std::transform(suffix.begin(), suffix.end(), suffix.begin(), ::toupper);
+    if (suffix == "K" || suffix == "KB") {
+        size <<= 10;
+    } else if (suffix == "M" || suffix == "MB") {
+        size <<= 20;
+    } else if (suffix == "G" || suffix == "GB") {
+        size <<= 30;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    return true;
+}
+
+void Shell::cmdFormat(const std::vector<std::string>& args) {
+    // 可选参数：磁盘大小、块大小、Inode 数；省略时沿用镜像大小并按默认比例计算
+    uint64_t disk_size = 0;
+    uint64_t block_size = BLOCK_SIZE;
+    uint64_t inode_count = 0;
+    if ((args.size() > 1 && !parseSize(args[1], disk_size)) ||
+        (args.size() > 2 && !parseSize(args[2], block_size)) ||
+        (args.size() > 3 && !parseSize(args[3], inode_count)) ||
+        block_size > UINT32_MAX || inode_count > UINT32_MAX) {
+        std::cout << "用法: format [大小(K/M/G)] [块大小] [Inode数]" << std::endl;
+        return;
+    }
+    
     std::cout << "警告：格式化将清除所有数据！" << std::endl;
     std::cout << "确认格式化？(yes/no): ";
     
@@ -162,7 +204,11 @@ void Shell::cmdFormat() {
     std::getline(std::cin, confirm);
     
     if (confirm == "yes" || confirm == "y") {
-        if (fs->format()) {
+        if (fs->format(disk_size, static_cast<uint32_t>(block_size),
+                       static_cast<uint32_t>(inode_count))) {
+            // 原有的目录已不存在，回到根目录
+            session.cwd_inode = 0;
+            session.cwd_path = "/";
             std::cout << "文件系统格式化完成" << std::endl;
         } else {
             std::cout << "格式化失败" << std::endl;
@@ -174,12 +220,22 @@ void Shell::cmdFormat() {
 
 void Shell::cmdMount() {
     if (fs->mount()) {
+        session.cwd_inode = 0;  // 挂载后从根目录开始
+        session.cwd_path = "/";
         std::cout << "文件系统挂载完成" << std::endl;
     } else {
         std::cout << "挂载失败" << std::endl;
     }
 }
 
+void Shell::cmdSync() {
+    if (fs->sync()) {
+        std::cout << "已写回磁盘" << std::endl;
+    } else {
+        std::cout << "写回失败" << std::endl;
+    }
+}
+
 void Shell::cmdLogin() {
     std::string username, password;
     
@@ -189,11 +245,11 @@ void Shell::cmdLogin() {
     std::cout << "密码: ";
     std::getline(std::cin, password);
     
-    fs->login(username, password);
+    fs->login(session, username, password);
 }
 
 void Shell::cmdLogout() {
-    fs->logout();
+    fs->logout(session);
 }
 
 void Shell::cmdLs(const std::vector<std::string>& args) {
@@ -202,42 +258,48 @@ void Shell::cmdLs(const std::vector<std::string>& args) {
         path = args[1];
     }
     
-    auto entries = fs->listDirectory(path);
-    
-    if (entries.empty()) {
-        std::cout << "(空目录)" << std::endl;
-        return;
-    }
-    
-    std::cout << std::left;
-    std::cout << std::setw(12) << "权限"
-              << std::setw(6) << "UID"
-              << std::setw(10) << "大小"
-              << std::setw(18) << "修改时间"
-              << "名称" << std::endl;
-    std::cout << std::string(70, '-') << std::endl;
-    
-    for (const auto& pair : entries) {
-        std::string type = (pair.second.file_type == FILE_TYPE_DIRECTORY) ? "d" : "-";
-        std::string perm = fs->permissionToString(pair.second.permission);
-        
-        // 修改时间
-        char time_str[20];
-        struct tm* timeinfo = localtime((time_t*)&pair.second.modify_time);
-        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", timeinfo);
-        
-        std::cout << std::setw(1) << type
-                  << std::setw(11) << perm
-                  << std::setw(6) << pair.second.owner_id
-                  << std::setw(10) << pair.second.file_size
-                  << std::setw(18) << time_str;
+    // 分批流式输出：每收到一批目录项（连同 Inode）就打印，不等整个目录读完
+    bool empty = true;
+    bool ok = fs->readDirectoryPlus(session, path, [this, &empty](const std::vector<DirEntryPlus>& batch) {
+        if (empty) {
+            std::cout << std::left;
+            std::cout << std::setw(12) << "权限"
+                      << std::setw(6) << "UID"
+                      << std::setw(10) << "大小"
+                      << std::setw(18) << "修改时间"
+                      << "名称" << std::endl;
+            std::cout << std::string(70, '-') << std::endl;
+            empty = false;
+        }
         
-        // 目录名称用不同颜色显示
-        if (pair.second.file_type == FILE_TYPE_DIRECTORY) {
-            std::cout << "\033[1;34m" << pair.first << "/\033[0m" << std::endl;
-        } else {
-            std::cout << pair.first << std::endl;
+        for (const auto& entry : batch) {
+            std::string type = (entry.inode.file_type == FILE_TYPE_DIRECTORY) ? "d" : "-";
+            std::string perm = fs->permissionToString(entry.inode.permission);
+            
+            // 修改时间
+            char time_str[20];
+            time_t modify_time = entry.inode.modify_time;
+            struct tm* timeinfo = localtime(&modify_time);
+            strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", timeinfo);
+            
+            std::cout << std::setw(1) << type
+                      << std::setw(11) << perm
+                      << std::setw(6) << entry.inode.owner_id
+                      << std::setw(10) << entry.inode.file_size
+                      << std::setw(18) << time_str;
+            
+            // 目录名称用不同颜色显示
+            if (entry.inode.file_type == FILE_TYPE_DIRECTORY) {
+                std::cout << "\033[1;34m" << entry.name << "/\033[0m" << std::endl;
+            } else {
+                std::cout << entry.name << std::endl;
+            }
         }
+        return true;
+    });
+    
+    if (ok && empty) {
+        std::cout << "(空目录)" << std::endl;
     }
 }
 
@@ -247,11 +309,11 @@ void Shell::cmdCd(const std::vector<std::string>& args) {
         return;
     }
     
-    fs->changeDirectory(args[1]);
+    fs->changeDirectory(session, args[1]);
 }
 
 void Shell::cmdPwd() {
-    std::cout << fs->getCurrentPath() << std::endl;
+    std::cout << session.cwd_path << std::endl;
 }
 
 void Shell::cmdMkdir(const std::vector<std::string>& args) {
@@ -260,7 +322,7 @@ void Shell::cmdMkdir(const std::vector<std::string>& args) {
         return;
     }
     
-    fs->createDirectory(args[1]);
+    fs->createDirectory(session, args[1]);
 }
 
 void Shell::cmdTouch(const std::vector<std::string>& args) {
@@ -269,7 +331,7 @@ void Shell::cmdTouch(const std::vector<std::string>& args) {
         return;
     }
     
-    fs->createFile(args[1]);
+    fs->createFile(session, args[1]);
 }
 
 void Shell::cmdRm(const std::vector<std::string>& args) {
@@ -278,7 +340,7 @@ void Shell::cmdRm(const std::vector<std::string>& args) {
         return;
     }
     
-    fs->removeFile(args[1]);
+    fs->removeFile(session, args[1]);
 }
 
 void Shell::cmdRmdir(const std::vector<std::string>& args) {
@@ -287,7 +349,7 @@ void Shell::cmdRmdir(const std::vector<std::string>& args) {
         return;
     }
     
-    fs->removeDirectory(args[1]);
+    fs->removeDirectory(session, args[1]);
 }
 
 void Shell::cmdCat(const std::vector<std::string>& args) {
@@ -296,7 +358,7 @@ void Shell::cmdCat(const std::vector<std::string>& args) {
         return;
     }
     
-    std::string content = fs->readFile(args[1]);
+    std::string content = fs->readFile(session, args[1]);
     if (!content.empty()) {
         std::cout << content << std::endl;
     }
@@ -309,7 +371,7 @@ void Shell::cmdWrite(const std::vector<std::string>& args) {
     }
 
     // 在提示输入内容之前先获取写锁，这样可以在尝试 write 时就阻止其他写者
-    if (!fs->lockFileForWrite(args[1])) {
+    if (!fs->lockFileForWrite(session, args[1])) {
         // 获取写锁失败（例如没有权限或文件不存在）
         return;
     }
@@ -328,15 +390,46 @@ void Shell::cmdWrite(const std::vector<std::string>& args) {
     }
 
     // 在已持有写锁的前提下写入文件
-    bool ok = fs->writeFileLocked(args[1], content);
+    bool ok = fs->writeFileLocked(session, args[1], content);
     // 无论成功与否，都要释放写锁
-    fs->unlockFileForWrite(args[1]);
+    fs->unlockFileForWrite(session, args[1]);
 
     if (!ok) {
         std::cout << "文件写入失败" << std::endl;
     }
 }
 
+void Shell::cmdAppend(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "用法: append <file>" << std::endl;
+        return;
+    }
+
+    if (!fs->lockFileForWrite(session, args[1])) {
+        return;
+    }
+
+    std::cout << "请输入追加内容（输入 EOF 结束）：" << std::endl;
+    
+    std::string content;
+    std::string line;
+    
+    while (true) {
+        std::getline(std::cin, line);
+        if (line == "EOF") {
+            break;
+        }
+        content += line + "\n";
+    }
+
+    bool ok = fs->appendFileLocked(session, args[1], content);
+    fs->unlockFileForWrite(session, args[1]);
+
+    if (!ok) {
+        std::cout << "文件追加失败" << std::endl;
+    }
+}
+
 void Shell::cmdChmod(const std::vector<std::string>& args) {
     if (args.size() < 3) {
         std::cout << "用法: chmod <mode> <file>" << std::endl;
@@ -349,7 +442,7 @@ void Shell::cmdChmod(const std::vector<std::string>& args) {
     std::istringstream iss(args[1]);
     iss >> std::oct >> mode;
     
-    fs->changePermission(args[2], mode);
+    fs->changePermission(session, args[2], mode);
 }
 
 void Shell::cmdChown(const std::vector<std::string>& args) {
@@ -359,17 +452,16 @@ void Shell::cmdChown(const std::vector<std::string>& args) {
     }
     
     uint16_t uid = std::stoi(args[1]);
-    fs->changeOwner(args[2], uid);
+    fs->changeOwner(session, args[2], uid);
 }
 
 void Shell::cmdAddUser() {
     // 只有 root 用户可以注册新用户
-    User* current = fs->getCurrentUser();
-    if (!current) {
+    if (!session.logged_in) {
         std::cout << "错误：请先登录 root 用户" << std::endl;
         return;
     }
-    if (!current->is_root) {
+    if (!session.user.is_root) {
         std::cout << "错误：只有 root 用户可以注册新用户" << std::endl;
         return;
     }
@@ -396,15 +488,42 @@ void Shell::cmdAddUser() {
 
 void Shell::cmdInfo() {
     std::cout << "\n文件系统信息：\n" << std::endl;
-    std::cout << "磁盘大小:     " << (DISK_SIZE / 1024 / 1024) << " MB" << std::endl;
-    std::cout << "块大小:       " << BLOCK_SIZE << " 字节" << std::endl;
-    std::cout << "总块数:       " << MAX_BLOCKS << std::endl;
-    std::cout << "总 Inode 数:  " << MAX_INODES << std::endl;
-    
-    if (fs->getCurrentUser()) {
-        std::cout << "\n当前用户:     " << fs->getCurrentUser()->username 
-                  << " (UID: " << fs->getCurrentUser()->uid << ")" << std::endl;
-        std::cout << "当前目录:     " << fs->getCurrentPath() << std::endl;
+    const SuperBlock& sb = fs->getSuperBlock();
+    std::cout << "磁盘大小:     " << (sb.diskSize() / 1024 / 1024) << " MB" << std::endl;
+    std::cout << "块大小:       " << sb.block_size << " 字节" << std::endl;
+    std::cout << "总块数:       " << sb.total_blocks << " (空闲 " << sb.free_blocks << ")" << std::endl;
+    std::cout << "总 Inode 数:  " << sb.total_inodes << " (空闲 " << sb.free_inodes << ")" << std::endl;
+    std::cout << "日志区块数:   " << sb.journal_blocks << std::endl;
+    std::cout << "分配组:       " << sb.group_count << " 组（每组 " << sb.blocks_per_group << " 块、"
+              << sb.inodes_per_group << " 个 Inode）" << std::endl;
+    
+    BlockCacheStats stats = fs->getCacheStats();
+    uint64_t lookups = stats.hits + stats.misses;
+    std::cout << "\n块缓存命中:   " << stats.hits << " / " << lookups;
+    if (lookups > 0) {
+        std::cout << " (" << std::fixed << std::setprecision(1)
+                  << (100.0 * stats.hits / lookups) << "%)";
+    }
+    std::cout << std::endl;
+    uint64_t dentry_hits = fs->getDentryHits();
+    uint64_t dentry_lookups = dentry_hits + fs->getDentryMisses();
+    std::cout << "目录项命中:   " << dentry_hits << " / " << dentry_lookups;
+    if (dentry_lookups > 0) {
+        std::cout << " (" << std::fixed << std::setprecision(1)
+                  << (100.0 * dentry_hits / dentry_lookups) << "%)";
+    }
+    std::cout << std::endl;
+    std::cout << "物理读写块数: 读 " << stats.disk_reads << ", 写 " << stats.disk_writes
+              << " (淘汰 " << stats.evictions << ", 刷盘 " << stats.flushes << " 次)" << std::endl;
+    std::cout << "异步 I/O 引擎: " << fs->getIOEngineName() << std::endl;
+    static const char* const durability_names[] = {"sync", "periodic", "none"};
+    std::cout << "持久性模式:   " << durability_names[fs->getDurability()] << std::endl;
+    std::cout << "延迟分配:     " << fs->getDelayedBlocks() << " 块待提交时分配" << std::endl;
+    
+    if (session.logged_in) {
+        std::cout << "\n当前用户:     " << session.user.username 
+                  << " (UID: " << session.user.uid << ")" << std::endl;
+        std::cout << "当前目录:     " << session.cwd_path << std::endl;
     }
     std::cout << std::endl;
 }
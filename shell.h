@@ -8,15 +8,18 @@
 class Shell {
 private:
     FileSystem* fs;
+    Session session;                   // 本 Shell 的登录用户和当前目录
     bool running;
     
     // 命令解析
     std::vector<std::string> parseCommand(const std::string& input);
+    bool parseSize(const std::string& text, uint64_t& size);
     
     // 命令处理函数
     void cmdHelp();
-    void cmdFormat();
+    void cmdFormat(const std::vector<std::string>& args);
     void cmdMount();
+    void cmdSync();
     void cmdLogin();
     void cmdLogout();
     void cmdLs(const std::vector<std::string>& args);
@@ -28,6 +31,7 @@ private:
     void cmdRmdir(const std::vector<std::string>& args);
     void cmdCat(const std::vector<std::string>& args);
     void cmdWrite(const std::vector<std::string>& args);
+    void cmdAppend(const std::vector<std::string>& args);
     void cmdChmod(const std::vector<std::string>& args);
     void cmdChown(const std::vector<std::string>& args);
     void cmdAddUser();
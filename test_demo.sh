@@ -17,7 +17,8 @@ echo "启动文件系统..."
 echo ""
 
 # 创建测试命令文件
-cat > test_commands.txt << 'EOF'
+# write 命令以单独一行 EOF 结束输入，外层 heredoc 换用 CMDS 作结束标记
+cat > test_commands.txt << 'CMDS'
 format
 yes
 mount
@@ -62,7 +63,7 @@ ls
 cd /
 logout
 exit
-EOF
+CMDS
 
 echo "运行测试命令..."
 ./myfs < test_commands.txt
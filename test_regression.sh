@@ -0,0 +1,248 @@
+#!/bin/bash
+
+# 回归测试：格式化 / 写入 / 重新挂载 / 校验
+# 每个用例在临时镜像上运行 myfs，退出（或被杀死）后重新挂载，检查数据是否完整。
+# 用法：make test（或先 make，再 ./test_regression.sh）
+
+cd "$(dirname "$0")" || exit 1
+
+BIN=./myfs
+if [ ! -x "$BIN" ]; then
+    echo "找不到 $BIN，请先运行 make"
+    exit 1
+fi
+
+# 镜像放在项目目录下而不是 /tmp：部分系统的 /tmp 是不支持 O_DIRECT 的 tmpfs
+WORK=$(mktemp -d ./regress.XXXXXX) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+PASSED=0
+FAILED=0
+OUT=""
+
+# 运行一次 myfs：第一个参数为镜像名，其余为命令行选项，命令从标准输入读取
+run() {
+    local image="$WORK/$1"
+    shift
+    OUT=$("$BIN" "$@" "$image" 2>&1)
+}
+
+# 挂载并以 root 登录后执行标准输入中的命令，最后退出
+session() {
+    local image=$1
+    shift
+    run "$image" "$@" < <(printf 'mount\nlogin\nroot\nroot\n'; cat; printf 'exit\n')
+}
+
+# 格式化后执行命令；第二个参数为 format 的参数
+fresh() {
+    local image=$1
+    local geometry=$2
+    shift 2
+    rm -f "$WORK/$image"
+    run "$image" "$@" < <(printf 'format %s\nyes\nmount\nlogin\nroot\nroot\n' "$geometry"; cat; printf 'exit\n')
+}
+
+# 输出中应包含指定文本
+expect() {
+    if grep -qF -- "$2" <<< "$OUT"; then
+        PASSED=$((PASSED + 1))
+    else
+        FAILED=$((FAILED + 1))
+        echo "失败：$1（输出中没有 \"$2\"）"
+    fi
+}
+
+# 输出中不应包含指定文本
+reject() {
+    if grep -qF -- "$2" <<< "$OUT"; then
+        FAILED=$((FAILED + 1))
+        echo "失败：$1（输出中出现了 \"$2\"）"
+    else
+        PASSED=$((PASSED + 1))
+    fi
+}
+
+# 输出中匹配正则的行数应等于给定值
+expect_count() {
+    local count
+    count=$(grep -cE -- "$2" <<< "$OUT")
+    if [ "$count" -eq "$3" ]; then
+        PASSED=$((PASSED + 1))
+    else
+        FAILED=$((FAILED + 1))
+        echo "失败：$1（匹配 $count 行，应为 $3 行）"
+    fi
+}
+
+# ============= 各存储后端：写入、追加、重新挂载 =============
+echo "[1] 存储后端"
+for backend in "--backend=fstream" "--backend=mmap" "--backend=pread" "--backend=pread --direct"; do
+    # shellcheck disable=SC2086
+    fresh backend.bin 16M $backend <<'CMDS'
+mkdir docs
+cd docs
+touch a.txt
+write a.txt
+first line
+second line
+EOF
+append a.txt
+third line
+EOF
+CMDS
+    expect "$backend 格式化" "文件系统格式化完成"
+    reject "$backend 写入" "文件写入失败"
+    reject "$backend 追加" "文件追加失败"
+
+    # shellcheck disable=SC2086
+    session backend.bin $backend <<'CMDS'
+cd docs
+cat a.txt
+CMDS
+    expect "$backend 重新挂载后读取" "first line
+second line
+third line"
+
+    # 换用默认后端读取同一镜像
+    session backend.bin <<'CMDS'
+cat docs/a.txt
+CMDS
+    expect "$backend 写入的镜像用 fstream 读取" "third line"
+done
+
+# ============= 格式化参数 =============
+echo "[2] 格式化参数"
+fresh geometry.bin 512K <<'CMDS'
+CMDS
+expect "元数据放不下时拒绝格式化" "错误：磁盘太小"
+
+fresh geometry.bin 64M 4096 4096 <<'CMDS'
+info
+CMDS
+expect "指定 Inode 数" "总 Inode 数:  4096"
+expect "64MB 的总块数" "总块数:       16384"
+
+session geometry.bin <<'CMDS'
+info
+CMDS
+expect "重新挂载后沿用超级块中的布局" "总 Inode 数:  4096"
+
+# ============= 大目录：哈希索引与叶块分裂 =============
+echo "[3] 大目录"
+{
+    echo "mkdir big"
+    echo "cd big"
+    for i in $(seq 0 599); do
+        echo "touch f$i"
+    done
+    echo "write f0"
+    echo "content of f0"
+    echo "EOF"
+    echo "write f599"
+    echo "content of f599"
+    echo "EOF"
+} | fresh dir.bin 16M
+reject "创建 600 个文件" "错误"
+
+session dir.bin <<'CMDS'
+cd big
+ls
+cat f0
+cat f599
+CMDS
+expect_count "重新挂载后列出全部文件" '  f[0-9]+$' 600
+expect "读取第一个文件" "content of f0"
+expect "读取最后一个文件" "content of f599"
+
+{
+    echo "cd big"
+    for i in $(seq 0 2 599); do
+        echo "rm f$i"
+    done
+    echo "touch again"
+} | session dir.bin
+reject "删除一半文件" "错误"
+
+session dir.bin <<'CMDS'
+cd big
+ls
+cat f599
+CMDS
+expect_count "删除后剩余的文件" '  f[0-9]+$' 300
+expect "删除后新建的文件" " again"
+expect "删除后读取其他文件" "content of f599"
+
+# ============= 延迟分配（periodic 模式）=============
+echo "[4] 延迟分配"
+fresh delayed.bin 16M --durability=periodic --flush-interval=600000 <<'CMDS'
+touch d.txt
+write d.txt
+delayed data
+EOF
+info
+sync
+info
+touch e.txt
+write e.txt
+written before exit
+EOF
+CMDS
+expect "写入后数据块待分配" "延迟分配:     1 块待提交时分配"
+expect "sync 后分配完毕" "延迟分配:     0 块待提交时分配"
+
+session delayed.bin <<'CMDS'
+cat d.txt
+cat e.txt
+CMDS
+expect "sync 提交的数据" "delayed data"
+expect "退出时提交的数据" "written before exit"
+
+# ============= 崩溃恢复：杀死进程后重放日志 =============
+echo "[5] 崩溃恢复"
+fresh crash.bin 16M <<'CMDS'
+CMDS
+
+# 通过管道喂入命令并保持写端打开，进程执行完命令后停在读取处，再用 SIGKILL 杀死，不经过正常卸载
+mkfifo "$WORK/crash.fifo"
+"$BIN" "$WORK/crash.bin" < "$WORK/crash.fifo" > "$WORK/crash.out" 2>&1 &
+PID=$!
+exec 3> "$WORK/crash.fifo"
+printf 'mount\nlogin\nroot\nroot\nmkdir crash\ncd crash\ntouch f\nwrite f\nsurvives the crash\nEOF\npwd\n' >&3
+for _ in $(seq 1 100); do
+    grep -q '\$ /crash$' "$WORK/crash.out" && break
+    sleep 0.1
+done
+kill -9 "$PID"
+wait "$PID" 2>/dev/null
+exec 3>&-
+
+session crash.bin <<'CMDS'
+cd crash
+cat f
+CMDS
+expect "挂载时重放日志" "日志恢复：重放了"
+expect "崩溃前写入的数据" "survives the crash"
+
+# ============= 权限 =============
+echo "[6] 权限"
+fresh perm.bin 16M <<'CMDS'
+touch secret
+write secret
+root only
+EOF
+chmod 600 secret
+CMDS
+
+run perm.bin < <(printf 'mount\nlogin\nuser1\n123456\ncat secret\nwrite secret\nx\nEOF\nexit\n')
+reject "其他用户不能读取 600 文件" "root only"
+expect "其他用户不能写入 600 文件" "错误：没有写权限"
+
+session perm.bin <<'CMDS'
+cat secret
+CMDS
+expect "所有者仍可读取" "root only"
+
+echo ""
+echo "通过 $PASSED 项，失败 $FAILED 项"
+[ "$FAILED" -eq 0 ]
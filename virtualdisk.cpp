@@ -0,0 +1,620 @@
+#include "virtualdisk.h"
+#include "asyncio.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+// ============= 对齐缓冲区 =============
+
+char* allocateBlockBuffer(uint32_t block_count) {
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, DISK_IO_ALIGNMENT, static_cast<size_t>(block_count) * BLOCK_SIZE) != 0) {
+        return nullptr;
+    }
+    return static_cast<char*>(ptr);
+}
+
+void freeBlockBuffer(char* buffer) {
+    free(buffer);
+}
+
+// ============= 镜像文件辅助函数 =============
+
+// 取得已有镜像的大小；新建（空）镜像扩展为默认大小。
+// ftruncate 只修改元数据，扩展部分为空洞，读出为 0
+static bool openImageSize(int fd, uint64_t& size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    size = static_cast<uint64_t>(st.st_size) / BLOCK_SIZE * BLOCK_SIZE;
+    if (size > 0) {
+        return true;
+    }
+    size = DEFAULT_DISK_SIZE;
+    return ftruncate(fd, static_cast<off_t>(size)) == 0;
+}
+
+// 把镜像调整为 size 字节并清空，代价与镜像大小无关：
+// 优先打洞（释放空间），其次 ZERO_RANGE，都不支持时截断后再扩展
+static bool discardImage(int fd, uint64_t size) {
+    off_t length = static_cast<off_t>(size);
+    if (ftruncate(fd, length) != 0) {
+        return false;
+    }
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, length) == 0) {
+        return true;
+    }
+    if (fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, length) == 0) {
+        return true;
+    }
+    return ftruncate(fd, 0) == 0 && ftruncate(fd, length) == 0;
+}
+
+// ============= VirtualDisk 工厂 =============
+
+VirtualDisk* VirtualDisk::create(const std::string& filename, DiskBackend backend, bool direct_io) {
+    if (backend == DISK_BACKEND_PREAD) {
+        FdDisk* disk = new FdDisk(filename, direct_io);
+        if (disk->isOpen()) {
+            return disk;
+        }
+        std::cerr << "警告：pread 后端初始化失败，改用 fstream 后端" << std::endl;
+        delete disk;
+    } else if (backend == DISK_BACKEND_MMAP) {
+        MmapDisk* disk = new MmapDisk(filename);
+        if (disk->isOpen()) {
+            return disk;
+        }
+        std::cerr << "警告：mmap 后端初始化失败，改用 fstream 后端" << std::endl;
+        delete disk;
+    }
+    return new FstreamDisk(filename);
+}
+
+void VirtualDisk::setSize(uint64_t size) {
+    block_count = static_cast<uint32_t>(size / BLOCK_SIZE);
+    disk_size = static_cast<uint64_t>(block_count) * BLOCK_SIZE;
+}
+
+VirtualDisk::~VirtualDisk() {
+    shutdownIO();
+    for (int fd : free_lock_fds) {
+        close(fd);
+    }
+}
+
+// ============= 跨进程字节范围锁 =============
+
+// 对 [offset, offset + length) 设置 OFD 锁；wait 为 true 时阻塞等待
+static int setRangeLock(int fd, short type, uint64_t offset, uint64_t length, bool wait) {
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = static_cast<off_t>(offset);
+    lock.l_len = static_cast<off_t>(length);
+    int result;
+    do {
+        result = fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock);
+    } while (result != 0 && errno == EINTR);
+    return result;
+}
+
+int VirtualDisk::lockRange(uint64_t offset, uint64_t length, bool exclusive, int timeout_ms) {
+    int fd = -1;
+    {
+        std::lock_guard<std::mutex> guard(lock_fds_mutex);
+        if (!free_lock_fds.empty()) {
+            fd = free_lock_fds.back();
+            free_lock_fds.pop_back();
+        }
+    }
+    if (fd < 0) {
+        fd = open(disk_filename.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+    }
+
+    short type = exclusive ? F_WRLCK : F_RDLCK;
+    bool locked;
+    if (timeout_ms < 0) {
+        locked = setRangeLock(fd, type, offset, length, true) == 0;
+    } else {
+        // 内核没有带超时的 F_OFD_SETLKW：非阻塞重试，间隔从 50us 指数退避到 5ms
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        auto backoff = std::chrono::microseconds(50);
+        while (!(locked = setRangeLock(fd, type, offset, length, false) == 0)) {
+            if ((errno != EAGAIN && errno != EACCES) ||
+                std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+            std::this_thread::sleep_for(backoff);
+            backoff = std::min(backoff * 2, std::chrono::microseconds(5000));
+        }
+    }
+
+    if (!locked) {
+        std::lock_guard<std::mutex> guard(lock_fds_mutex);
+        free_lock_fds.push_back(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void VirtualDisk::unlockRange(int handle, uint64_t offset, uint64_t length) {
+    if (handle < 0) {
+        return;
+    }
+    if (setRangeLock(handle, F_UNLCK, offset, length, false) != 0) {
+        // 无法解锁的描述符不再复用，关闭它即释放其上的全部锁
+        close(handle);
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock_fds_mutex);
+    free_lock_fds.push_back(handle);
+}
+
+void VirtualDisk::shutdownIO() {
+    delete io_engine;
+    io_engine = nullptr;
+}
+
+bool VirtualDisk::submitIO(const BlockIORequest* requests, size_t count) {
+    if (!io_engine) {
+        io_engine = AsyncIOEngine::create(this);
+    }
+    return io_engine->submit(requests, count);
+}
+
+size_t VirtualDisk::completeIO(BlockIOCompletion* completions, size_t max, bool wait) {
+    if (!io_engine) {
+        return 0;
+    }
+    return io_engine->complete(completions, max, wait);
+}
+
+bool VirtualDisk::runIO(const std::vector<BlockIORequest>& requests) {
+    if (requests.empty()) {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(io_mutex);
+    uint64_t batch = next_batch++;
+    std::vector<BlockIORequest> tagged(requests);
+    for (auto& request : tagged) {
+        request.tag = batch;
+    }
+    if (!submitIO(tagged.data(), tagged.size())) {
+        return false;
+    }
+    io_batches[batch] = tagged.size();
+
+    // 等待本批全部完成（完成顺序任意）。收割到的可能是其他线程的请求，
+    // 记入其批次即可；每轮之间释放锁，让其他线程有机会提交或取走结果
+    std::vector<BlockIOCompletion> completions(tagged.size());
+    while (io_batches[batch] > 0) {
+        size_t n = completeIO(completions.data(), completions.size(), true);
+        if (n == 0) {
+            io_batches.erase(batch);
+            io_failed.erase(batch);
+            return false;
+        }
+        for (size_t i = 0; i < n; i++) {
+            auto it = io_batches.find(completions[i].tag);
+            if (it == io_batches.end()) {
+                continue;
+            }
+            it->second--;
+            if (!completions[i].ok) {
+                io_failed[completions[i].tag] = true;
+            }
+        }
+        if (io_batches[batch] > 0) {
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+    }
+    bool ok = io_failed.erase(batch) == 0;
+    io_batches.erase(batch);
+    return ok;
+}
+
+const char* VirtualDisk::ioEngineName() {
+    std::lock_guard<std::mutex> lock(io_mutex);
+    if (!io_engine) {
+        io_engine = AsyncIOEngine::create(this);
+    }
+    return io_engine->name();
+}
+
+bool VirtualDisk::readBlocks(uint32_t start, uint32_t count, char* const* buffers) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (!readBlock(start + i, buffers[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VirtualDisk::writeBlocks(uint32_t start, uint32_t count, const char* const* buffers) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (!writeBlock(start + i, buffers[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============= FstreamDisk 实现 =============
+
+FstreamDisk::FstreamDisk(const std::string& filename) : VirtualDisk(filename), sync_fd(-1) {
+    // 不存在则创建稀疏镜像，再以读写方式打开；描述符保留下来用于刷盘
+    int fd = ::open(disk_filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return;
+    }
+    uint64_t size;
+    if (!openImageSize(fd, size)) {
+        ::close(fd);
+        return;
+    }
+    setSize(size);
+    sync_fd = fd;
+    disk_file.open(disk_filename, std::ios::in | std::ios::out | std::ios::binary);
+}
+
+FstreamDisk::~FstreamDisk() {
+    shutdownIO();
+    if (disk_file.is_open()) {
+        disk_file.close();
+    }
+    if (sync_fd >= 0) {
+        ::close(sync_fd);
+    }
+}
+
+bool FstreamDisk::format(uint64_t size) {
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    if (!disk_file.is_open()) {
+        return false;
+    }
+
+    // fstream 没有文件描述符，先把缓冲区写出，再用独立的描述符清空镜像；
+    // 之后每次读写都会重新定位，流内的旧缓冲不会被使用
+    disk_file.flush();
+    bool ok = discardImage(sync_fd, size);
+    if (ok) {
+        setSize(size);
+    }
+    disk_file.clear();
+    disk_file.seekg(0);
+    return ok;
+}
+
+bool FstreamDisk::readBlock(uint32_t block_num, char* buffer) {
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    if (!disk_file.is_open() || block_num >= block_count) {
+        return false;
+    }
+
+    disk_file.seekg(static_cast<std::streamoff>(block_num) * BLOCK_SIZE);
+    disk_file.read(buffer, BLOCK_SIZE);
+    return disk_file.good();
+}
+
+bool FstreamDisk::writeBlock(uint32_t block_num, const char* buffer) {
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    if (!disk_file.is_open() || block_num >= block_count) {
+        return false;
+    }
+
+    disk_file.seekp(static_cast<std::streamoff>(block_num) * BLOCK_SIZE);
+    disk_file.write(buffer, BLOCK_SIZE);
+    return disk_file.good();
+}
+
+bool FstreamDisk::flush() {
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    if (!disk_file.is_open()) {
+        return false;
+    }
+    disk_file.flush();
+    if (!disk_file.good()) {
+        return false;
+    }
+    // 同一文件任一描述符上的 fdatasync 都会写回流刚交给内核的数据
+    return !durable || fdatasync(sync_fd) == 0;
+}
+
+bool FstreamDisk::isOpen() const {
+    return disk_file.is_open();
+}
+
+// ============= MmapDisk 实现 =============
+
+MmapDisk::MmapDisk(const std::string& filename)
+    : VirtualDisk(filename), fd(-1), mapping(nullptr), dirty_begin(UINT32_MAX), dirty_end(0) {
+    fd = ::open(disk_filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return;
+    }
+
+    // 新建的磁盘文件扩展到默认大小（扩展部分读出为 0）
+    uint64_t size;
+    if (!openImageSize(fd, size) || !remap(size)) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool MmapDisk::remap(uint64_t size) {
+    if (mapping) {
+        munmap(mapping, disk_size);
+        mapping = nullptr;
+    }
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    mapping = static_cast<char*>(addr);
+    setSize(size);
+    return true;
+}
+
+MmapDisk::~MmapDisk() {
+    shutdownIO();
+    if (mapping) {
+        flush();
+        munmap(mapping, disk_size);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool MmapDisk::format(uint64_t size) {
+    if (!mapping) {
+        return false;
+    }
+    // 打洞会同时丢弃映射中的页，之后访问读到的都是 0；大小变化时重新映射
+    std::lock_guard<std::mutex> lock(dirty_mutex);
+    dirty_begin = UINT32_MAX;
+    dirty_end = 0;
+    if (!discardImage(fd, size)) {
+        return false;
+    }
+    return size == disk_size || remap(size);
+}
+
+bool MmapDisk::readBlock(uint32_t block_num, char* buffer) {
+    if (!mapping || block_num >= block_count) {
+        return false;
+    }
+    memcpy(buffer, mapping + static_cast<size_t>(block_num) * BLOCK_SIZE, BLOCK_SIZE);
+    return true;
+}
+
+bool MmapDisk::writeBlock(uint32_t block_num, const char* buffer) {
+    if (!mapping || block_num >= block_count) {
+        return false;
+    }
+    memcpy(mapping + static_cast<size_t>(block_num) * BLOCK_SIZE, buffer, BLOCK_SIZE);
+    markBlockDirty(block_num);
+    return true;
+}
+
+bool MmapDisk::flush() {
+    if (!mapping) {
+        return false;
+    }
+    size_t offset;
+    size_t length;
+    {
+        std::lock_guard<std::mutex> lock(dirty_mutex);
+        if (dirty_begin >= dirty_end) {
+            return true;
+        }
+        offset = static_cast<size_t>(dirty_begin) * BLOCK_SIZE;
+        length = static_cast<size_t>(dirty_end - dirty_begin) * BLOCK_SIZE;
+        dirty_begin = UINT32_MAX;
+        dirty_end = 0;
+    }
+    // 非持久模式只发起写回，不等待完成
+    return msync(mapping + offset, length, durable ? MS_SYNC : MS_ASYNC) == 0;
+}
+
+bool MmapDisk::isOpen() const {
+    return mapping != nullptr;
+}
+
+char* MmapDisk::mapBlock(uint32_t block_num) {
+    if (!mapping || block_num >= block_count) {
+        return nullptr;
+    }
+    return mapping + static_cast<size_t>(block_num) * BLOCK_SIZE;
+}
+
+void MmapDisk::markBlockDirty(uint32_t block_num) {
+    std::lock_guard<std::mutex> lock(dirty_mutex);
+    if (block_num < dirty_begin) {
+        dirty_begin = block_num;
+    }
+    if (block_num + 1 > dirty_end) {
+        dirty_end = block_num + 1;
+    }
+}
+
+// ============= FdDisk 实现 =============
+
+FdDisk::FdDisk(const std::string& filename, bool direct_io)
+    : VirtualDisk(filename), fd(-1), direct_io(direct_io) {
+    int flags = O_RDWR | O_CREAT;
+    if (direct_io) {
+        fd = ::open(disk_filename.c_str(), flags | O_DIRECT, 0644);
+        if (fd < 0 && errno == EINVAL) {
+            // 部分文件系统（如 tmpfs）不支持 O_DIRECT
+            std::cerr << "警告：当前文件系统不支持 O_DIRECT，改用缓冲 I/O" << std::endl;
+            this->direct_io = false;
+        }
+    }
+    if (fd < 0) {
+        fd = ::open(disk_filename.c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+        return;
+    }
+
+    uint64_t size;
+    if (!openImageSize(fd, size)) {
+        ::close(fd);
+        fd = -1;
+        return;
+    }
+    setSize(size);
+}
+
+FdDisk::~FdDisk() {
+    shutdownIO();
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool FdDisk::isAligned(const char* buffer) const {
+    return reinterpret_cast<uintptr_t>(buffer) % DISK_IO_ALIGNMENT == 0;
+}
+
+bool FdDisk::transfer(uint32_t start, uint32_t count, char* const* buffers, bool write) {
+    if (fd < 0 || !inRange(start, count)) {
+        return false;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    // O_DIRECT 下任一缓冲区未对齐时，整段经由对齐的临时缓冲区中转
+    char* bounce = nullptr;
+    if (direct_io) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (!isAligned(buffers[i])) {
+                bounce = allocateBlockBuffer(count);
+                if (!bounce) {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+
+    std::vector<struct iovec> iov;
+    if (bounce) {
+        if (write) {
+            for (uint32_t i = 0; i < count; i++) {
+                memcpy(bounce + static_cast<size_t>(i) * BLOCK_SIZE, buffers[i], BLOCK_SIZE);
+            }
+        }
+        struct iovec v;
+        v.iov_base = bounce;
+        v.iov_len = static_cast<size_t>(count) * BLOCK_SIZE;
+        iov.push_back(v);
+    } else {
+        iov.resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            iov[i].iov_base = buffers[i];
+            iov[i].iov_len = BLOCK_SIZE;
+        }
+    }
+
+    off_t offset = static_cast<off_t>(start) * BLOCK_SIZE;
+    size_t next = 0;
+    bool ok = true;
+    while (next < iov.size()) {
+        int n = static_cast<int>(std::min<size_t>(iov.size() - next, IOV_MAX));
+        ssize_t done = write ? pwritev(fd, &iov[next], n, offset)
+                             : preadv(fd, &iov[next], n, offset);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            ok = false;
+            break;
+        }
+
+        // 处理部分完成：跳过已传输的 iovec，调整剩余的首个 iovec
+        offset += done;
+        while (done > 0) {
+            size_t len = iov[next].iov_len;
+            if (static_cast<size_t>(done) >= len) {
+                done -= len;
+                next++;
+            } else {
+                iov[next].iov_base = static_cast<char*>(iov[next].iov_base) + done;
+                iov[next].iov_len -= done;
+                done = 0;
+            }
+        }
+    }
+
+    if (bounce) {
+        if (ok && !write) {
+            for (uint32_t i = 0; i < count; i++) {
+                memcpy(buffers[i], bounce + static_cast<size_t>(i) * BLOCK_SIZE, BLOCK_SIZE);
+            }
+        }
+        freeBlockBuffer(bounce);
+    }
+    return ok;
+}
+
+bool FdDisk::format(uint64_t size) {
+    if (fd < 0) {
+        return false;
+    }
+    if (!discardImage(fd, size)) {
+        return false;
+    }
+    setSize(size);
+    return flush();
+}
+
+bool FdDisk::readBlock(uint32_t block_num, char* buffer) {
+    return transfer(block_num, 1, &buffer, false);
+}
+
+bool FdDisk::writeBlock(uint32_t block_num, const char* buffer) {
+    char* buf = const_cast<char*>(buffer);
+    return transfer(block_num, 1, &buf, true);
+}
+
+bool FdDisk::readBlocks(uint32_t start, uint32_t count, char* const* buffers) {
+    return transfer(start, count, buffers, false);
+}
+
+bool FdDisk::writeBlocks(uint32_t start, uint32_t count, const char* const* buffers) {
+    return transfer(start, count, const_cast<char* const*>(buffers), true);
+}
+
+bool FdDisk::flush() {
+    if (fd < 0) {
+        return false;
+    }
+    return !durable || fdatasync(fd) == 0;
+}
+
+bool FdDisk::isOpen() const {
+    return fd >= 0;
+}
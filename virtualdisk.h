@@ -0,0 +1,196 @@
+#ifndef VIRTUALDISK_H
+#define VIRTUALDISK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+// ============= 磁盘几何常量 =============
+// 镜像大小在运行时确定：打开已有镜像时取其文件大小，格式化时由调用者指定
+const uint64_t DEFAULT_DISK_SIZE = 10 * 1024 * 1024;  // 新建镜像的默认大小（10MB）
+const uint32_t BLOCK_SIZE = 4096;              // 4KB 块大小
+const uint32_t DISK_IO_ALIGNMENT = 4096;       // O_DIRECT 要求的缓冲区/偏移对齐
+
+// 分配/释放满足 O_DIRECT 对齐要求的块缓冲区
+char* allocateBlockBuffer(uint32_t block_count);
+void freeBlockBuffer(char* buffer);
+
+// ============= 磁盘后端类型 =============
+enum DiskBackend {
+    DISK_BACKEND_FSTREAM = 0,  // std::fstream 读写（默认）
+    DISK_BACKEND_MMAP = 1,     // mmap 映射整个磁盘文件
+    DISK_BACKEND_PREAD = 2     // 文件描述符 + pread/pwrite 定位读写
+};
+
+// ============= 异步块 I/O 请求 =============
+struct BlockIORequest {
+    uint32_t block_num;  // 起始块号
+    uint32_t count;      // 连续块数
+    char* buffer;        // count * BLOCK_SIZE 字节的连续缓冲区
+    bool write;          // true 为写，false 为读
+    uint64_t tag;        // 调用者自定义标识，原样出现在完成事件中
+};
+
+struct BlockIOCompletion {
+    uint64_t tag;
+    bool ok;
+};
+
+class AsyncIOEngine;
+
+// ============= 虚拟磁盘接口 =============
+class VirtualDisk {
+protected:
+    std::string disk_filename;
+    AsyncIOEngine* io_engine;  // 按需创建的异步 I/O 引擎
+    bool durable;              // flush 是否等待数据真正落盘
+    uint64_t disk_size;        // 镜像字节数（块大小的整数倍）
+    uint32_t block_count;      // 镜像块数
+
+    void setSize(uint64_t size);
+    bool inRange(uint32_t start, uint32_t count) const {
+        return start < block_count && count <= block_count - start;
+    }
+
+    void shutdownIO();         // 派生类析构时先停止引擎，再关闭文件
+
+private:
+    // runIO 可被多个线程同时调用：提交和收割都在 io_mutex 下进行，
+    // 每批请求以批号为 tag，收割到的完成事件记入对应批次，由各自的调用者取走
+    std::mutex io_mutex;
+    std::unordered_map<uint64_t, size_t> io_batches;  // 批号 -> 未完成的请求数
+    std::unordered_map<uint64_t, bool> io_failed;     // 出错的批次
+    uint64_t next_batch;
+
+    std::mutex lock_fds_mutex;
+    std::vector<int> free_lock_fds;  // 空闲的加锁描述符，加锁时复用，避免每次 open
+
+public:
+    VirtualDisk(const std::string& filename)
+        : disk_filename(filename), io_engine(nullptr), durable(true), disk_size(0), block_count(0),
+          next_batch(0) {}
+    virtual ~VirtualDisk();
+
+    // 按后端类型创建虚拟磁盘；direct_io 仅对 pread 后端有效（O_DIRECT）
+    static VirtualDisk* create(const std::string& filename, DiskBackend backend,
+                               bool direct_io = false);
+
+    // 把镜像调整为 size 字节并清空（稀疏释放，读出为 0）
+    virtual bool format(uint64_t size) = 0;
+    virtual bool readBlock(uint32_t block_num, char* buffer) = 0;
+    virtual bool writeBlock(uint32_t block_num, const char* buffer) = 0;
+    virtual bool flush() = 0;   // 将已写入的数据刷到磁盘文件
+    // 关闭后 flush 只把数据交给宿主内核（不再 fdatasync/同步 msync），崩溃时可能丢失
+    void setDurable(bool enabled) { durable = enabled; }
+    virtual bool isOpen() const = 0;
+    uint64_t getSize() const { return disk_size; }
+    uint32_t getBlockCount() const { return block_count; }
+
+    // 连续块的批量读写：buffers[i] 对应第 start + i 块。
+    // 默认逐块调用 readBlock/writeBlock，支持向量 I/O 的后端可以覆盖。
+    virtual bool readBlocks(uint32_t start, uint32_t count, char* const* buffers);
+    virtual bool writeBlocks(uint32_t start, uint32_t count, const char* const* buffers);
+
+    // 异步 I/O：submitIO 一次提交一批请求，completeIO 收割完成事件（乱序）。
+    // 这两个接口只能由单个线程使用；多线程请使用 runIO
+    bool submitIO(const BlockIORequest* requests, size_t count);
+    size_t completeIO(BlockIOCompletion* completions, size_t max, bool wait);
+    bool runIO(const std::vector<BlockIORequest>& requests);  // 提交并等待全部完成（线程安全）
+    const char* ioEngineName();
+
+    // 跨进程字节范围锁（OFD fcntl 锁）。每把锁使用一个独立打开的文件描述，
+    // 因此不同进程之间、同一进程的不同线程之间都按共享/独占语义互斥，
+    // 持有者退出或崩溃时由内核自动释放。
+    // timeout_ms < 0 一直等待，0 只尝试一次；成功返回锁句柄，超时或出错返回 -1
+    int lockRange(uint64_t offset, uint64_t length, bool exclusive, int timeout_ms);
+    void unlockRange(int handle, uint64_t offset, uint64_t length);
+
+    // 供异步引擎使用：原生文件描述符（无则为 -1）及是否 O_DIRECT
+    virtual int nativeFd() const { return -1; }
+    virtual bool isDirectIO() const { return false; }
+
+    // 映射型后端：直接返回块在映射区中的地址，调用者原地读写
+    virtual bool isMapped() const { return false; }
+    virtual char* mapBlock(uint32_t /* block_num */) { return nullptr; }
+    virtual void markBlockDirty(uint32_t /* block_num */) {}
+};
+
+// ============= fstream 后端 =============
+// 流有共享的读写位置，定位与读写在同一把锁下完成
+class FstreamDisk : public VirtualDisk {
+private:
+    std::fstream disk_file;
+    std::mutex stream_mutex;
+    int sync_fd;               // 流没有文件描述符，另开一个用于 fdatasync
+
+public:
+    FstreamDisk(const std::string& filename);
+    ~FstreamDisk();
+
+    bool format(uint64_t size);
+    bool readBlock(uint32_t block_num, char* buffer);
+    bool writeBlock(uint32_t block_num, const char* buffer);
+    bool flush();
+    bool isOpen() const;
+};
+
+// ============= mmap 后端 =============
+// 整个磁盘文件以 MAP_SHARED 映射，块读写就是内存拷贝，
+// 持久化由 flush() 中对脏区间的 msync 完成。
+class MmapDisk : public VirtualDisk {
+private:
+    int fd;
+    char* mapping;
+    uint32_t dirty_begin;  // 脏块区间 [dirty_begin, dirty_end)
+    uint32_t dirty_end;
+    std::mutex dirty_mutex;
+
+    bool remap(uint64_t size);  // 按新的镜像大小重新映射
+
+public:
+    MmapDisk(const std::string& filename);
+    ~MmapDisk();
+
+    bool format(uint64_t size);
+    bool readBlock(uint32_t block_num, char* buffer);
+    bool writeBlock(uint32_t block_num, const char* buffer);
+    bool flush();
+    bool isOpen() const;
+
+    bool isMapped() const { return mapping != nullptr; }
+    char* mapBlock(uint32_t block_num);
+    void markBlockDirty(uint32_t block_num);
+};
+
+// ============= pread/pwrite 后端 =============
+// 使用定位读写，不共享文件偏移，可被多个线程同时调用。
+// 连续块走 preadv/pwritev；可选 O_DIRECT 绕过宿主页缓存，
+// 此时未对齐的调用者缓冲区会经由对齐的临时缓冲区中转。
+class FdDisk : public VirtualDisk {
+private:
+    int fd;
+    bool direct_io;
+
+    bool isAligned(const char* buffer) const;
+    bool transfer(uint32_t start, uint32_t count, char* const* buffers, bool write);
+
+public:
+    FdDisk(const std::string& filename, bool direct_io);
+    ~FdDisk();
+
+    bool format(uint64_t size);
+    bool readBlock(uint32_t block_num, char* buffer);
+    bool writeBlock(uint32_t block_num, const char* buffer);
+    bool readBlocks(uint32_t start, uint32_t count, char* const* buffers);
+    bool writeBlocks(uint32_t start, uint32_t count, const char* const* buffers);
+    bool flush();
+    bool isOpen() const;
+
+    int nativeFd() const { return fd; }
+    bool isDirectIO() const { return direct_io; }
+};
+
+#endif // VIRTUALDISK_H